@@ -0,0 +1,142 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meminfo.h"
+#include "memory.h"
+#include "procfile.h"
+
+// Microbenchmark for sampling /proc/meminfo.  Times the old stdio parser,
+// which did an fopen(), fgets() and sscanf() per sample and a chain of strcmp()
+// calls per line, against procfile_read() and the perfect hash lookup that
+// swapspace uses now.  Takes the number of samples on the command line.
+
+char localbuf[16384];
+
+/// The old way: parse one sample through stdio
+static bool stdio_sample(struct memstate *st)
+{
+  FILE *fp = fopen("/proc/meminfo", "r");
+  if (!fp) return false;
+  char entry[200], fact[20];
+  memsize_t value;
+  while (fgets(localbuf, sizeof(localbuf), fp))
+  {
+    const int x = sscanf(localbuf, "%199[^:]: %lld %19s", entry, &value, fact);
+    if (x < 2) continue;
+    if (x == 3 && strcmp(fact, "kB") == 0) value *= KILO;
+    switch (entry[0])
+    {
+    case 'B':
+      if (strcmp(entry, "Buffers")==0)		st->Buffers = value;
+      break;
+    case 'C':
+      if (strcmp(entry, "Cached")==0)		st->Cached = value;
+      break;
+    case 'D':
+      if (strcmp(entry, "Dirty")==0)		st->Dirty = value;
+      break;
+    case 'M':
+      if (strcmp(entry, "MemTotal")==0)		st->MemTotal = value;
+      else if (strcmp(entry, "MemFree")==0)	st->MemFree = value;
+      else if (strcmp(entry, "MemAvailable")==0) st->MemAvailable = value;
+      break;
+    case 'S':
+      if (strcmp(entry, "SwapTotal")==0)	st->SwapTotal = value;
+      else if (strcmp(entry, "SwapFree")==0)	st->SwapFree = value;
+      else if (strcmp(entry, "SwapCached")==0)	st->SwapCached = value;
+      else if (strcmp(entry, "Shmem")==0)	st->Shmem = value;
+      break;
+    case 'W':
+      if (strcmp(entry, "Writeback")==0)	st->Writeback = value;
+      break;
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+
+static struct procfile proc_meminfo = PROCFILE("/proc/meminfo");
+
+/// The new way: one pread() per sample, one hash probe per line
+static bool procfile_sample(struct memstate *st)
+{
+  if (procfile_read(&proc_meminfo) < 0) return false;
+  const char *pos = localbuf;
+  struct procfield f;
+  while (procfile_field(&pos, &f))
+  {
+    memsize_t *const member = meminfo_member(st, f.name, f.namelen);
+    if (member) *member = f.value;
+  }
+  return true;
+}
+
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/// Take samples with sample(), and print how long each took on average
+static bool bench(const char name[],
+    bool (*sample)(struct memstate *),
+    unsigned long samples)
+{
+  struct memstate st;
+  const double start = now();
+  for (unsigned long i = 0; i < samples; ++i)
+  {
+    memset(&st, 0, sizeof(st));
+    if (!sample(&st))
+    {
+      fprintf(stderr, "%s: could not read /proc/meminfo\n", name);
+      return false;
+    }
+  }
+  const double secs = now() - start;
+  printf("%-8s %9.0f ns per sample (MemTotal %lld)\n",
+      name,
+      secs*1e9/samples,
+      st.MemTotal);
+  return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+  unsigned long samples = 100000;
+  if (argc > 2 || (argc == 2 && !(samples = strtoul(argv[1], NULL, 0))))
+  {
+    fprintf(stderr, "Usage: %s [samples]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!bench("stdio", stdio_sample, samples) ||
+      !bench("procfile", procfile_sample, samples))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,524 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/param.h>
+
+#include "cgroup.h"
+#include "log.h"
+#include "opts.h"
+#include "procfile.h"
+#include "support.h"
+
+
+/// Configuration item: root of cgroup subtree to watch; empty to disable
+static char cgroup_root[PATH_MAX] = "";
+
+/// Configuration item: cgroup is under pressure at n% of its memory limit
+static int cgroup_pressure = 90;
+
+/// Configuration item: divide n% of all swap among cgroups; 0 disables
+static int cgroup_swap_share = 0;
+
+#ifndef NO_CONFIG
+char *set_cgroup_root(long long dummy)
+{
+  return cgroup_root;
+}
+char *set_cgroup_pressure(long long pct)
+{
+  cgroup_pressure = (int)pct;
+  return NULL;
+}
+char *set_cgroup_swap_share(long long pct)
+{
+  cgroup_swap_share = (int)pct;
+  return NULL;
+}
+
+bool cgroup_check_config(void)
+{
+  if (cgroup_root[0] && cgroup_root[0] != '/')
+  {
+    logm(LOG_ERR,
+	"cgroup root is not absolute (must start with '/'): '%s'",
+	cgroup_root);
+    return false;
+  }
+  CHECK_CONFIG_ERR(cgroup_swap_share && !cgroup_root[0]);
+  return true;
+}
+#endif
+
+
+/// Most cgroups we keep track of
+/** Each takes up to two file descriptors.
+ */
+#define MAX_CGROUPS 256
+
+/// Rescan the cgroup hierarchy this often (in seconds)
+#define CGROUP_RESCAN_INTERVAL 30
+
+/// Write at most this many swap budgets per call to cgroup_demand()
+#define BUDGET_BATCH 16
+
+struct cgroup
+{
+  /// The cgroup's directory, kept open until the next rescan
+  int dirfd;
+  /// memory.current, kept open if the cgroup has a memory limit; or -1
+  int current_fd;
+  /// Index of parent cgroup, or -1 for cgroup_root itself
+  int parent;
+  /// Lesser of memory.high and memory.max, or -1 for none
+  memsize_t limit;
+  /// memory.swap.max, or -1 for none
+  memsize_t swap_max;
+
+  /// Do we manage this cgroup's swap limits?
+  /** With cgroup_swap_share set, we do so for every cgroup that has a memory
+   * limit, but no ancestor below cgroup_root that has one.  On a Kubernetes
+   * node, those are the pods.
+   */
+  bool budgeted;
+  /// Is this cgroup, or one of its ancestors, budgeted?
+  bool in_budget;
+  /// Swap limit we'd like the cgroup to have
+  memsize_t budget;
+  /// Does budget need to be written out?
+  bool budget_dirty;
+
+  // As of the last sample
+  memsize_t current;
+  /// Anonymous and shared memory; only sampled while under pressure
+  memsize_t swappable;
+  /// memory.swap.current; only sampled while under pressure
+  memsize_t swap_current;
+  /// memory.events counters; only sampled while under pressure
+  long long max_events, oom_kills;
+  /// Swap wanted by this cgroup itself
+  memsize_t demand;
+  /// Swap wanted by this cgroup's children, together
+  memsize_t child_demand;
+  /// Swap wanted by this cgroup and its descendants
+  memsize_t total_demand;
+
+  /// Directory name, possibly truncated; for status reports only
+  char name[64];
+};
+
+/// Tracked cgroups.  Every cgroup comes after its parent.
+static struct cgroup cgroups[MAX_CGROUPS];
+static int num_cgroups = 0;
+
+/// runclock at last scan of the hierarchy, or -1 if not scanned yet
+static time_t last_scan = -1;
+/// Did we run out of room in cgroups[] during the last scan?
+static bool cgroups_overflow = false;
+
+
+/// Read small file in directory dirfd into buf, nul-terminated
+/**
+ * @return Number of bytes read, or -1 on failure
+ */
+static ssize_t read_at(int dirfd, const char file[], char buf[], size_t size)
+{
+  const int fd = openat(dirfd, file, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) return -1;
+  const ssize_t len = read(fd, buf, size-1);
+  close(fd);
+  if (len < 0) return -1;
+  buf[len] = '\0';
+  return len;
+}
+
+
+/// Parse a cgroup memory figure: a number of bytes, or "max" for none (-1)
+static memsize_t cgroup_value(const char *p)
+{
+  if (strncmp(p, "max", 3) == 0) return -1;
+  if (*p < '0' || *p > '9') return MEMSIZE_ERROR;
+  memsize_t v = 0;
+  while (*p >= '0' && *p <= '9') v = v*10 + (*p++ - '0');
+  return v;
+}
+
+
+/// Read a cgroup memory figure from file in directory dirfd
+/**
+ * @return The figure, -1 for none, or MEMSIZE_ERROR if it could not be read
+ */
+static memsize_t read_value_at(int dirfd, const char file[])
+{
+  char buf[32];
+  if (read_at(dirfd, file, buf, sizeof(buf)) <= 0) return MEMSIZE_ERROR;
+  return cgroup_value(buf);
+}
+
+
+static void forget_cgroups(void)
+{
+  for (int i = 0; i < num_cgroups; ++i)
+  {
+    close(cgroups[i].dirfd);
+    if (cgroups[i].current_fd != -1) close(cgroups[i].current_fd);
+  }
+  num_cgroups = 0;
+}
+
+
+/// Add cgroup whose directory is open as dirfd
+static void add_cgroup(int parent, int dirfd, const char name[])
+{
+  struct cgroup *const cg = &cgroups[num_cgroups++];
+  memset(cg, 0, sizeof(*cg));
+  cg->dirfd = dirfd;
+  cg->parent = parent;
+  strncpy(cg->name, name, sizeof(cg->name)-1);
+
+  // Limits don't change often; we pick up any changes at the next rescan.
+  const memsize_t max = read_value_at(dirfd, "memory.max"),
+	          high = read_value_at(dirfd, "memory.high");
+  cg->limit = -1;
+  if (max >= 0) cg->limit = max;
+  if (high >= 0 && (cg->limit < 0 || high < cg->limit)) cg->limit = high;
+
+  // Without swap accounting, there is no memory.swap.max; no limit, then.
+  cg->swap_max = read_value_at(dirfd, "memory.swap.max");
+  if (cg->swap_max < 0) cg->swap_max = -1;
+
+  // A cgroup without a limit of its own can't run short by itself.
+  cg->current_fd = -1;
+  if (cg->limit > 0)
+    cg->current_fd = openat(dirfd, "memory.current", O_RDONLY|O_CLOEXEC);
+
+  if (parent > 0 && cgroups[parent].in_budget)
+    cg->in_budget = true;
+  else if (parent >= 0 && cgroup_swap_share && cg->limit > 0)
+    cg->in_budget = cg->budgeted = true;
+}
+
+
+/// Reread the cgroup hierarchy below cgroup_root
+static bool scan_cgroups(void)
+{
+  forget_cgroups();
+  cgroups_overflow = false;
+  last_scan = runclock;
+
+  const int rootfd = open(cgroup_root, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (unlikely(rootfd == -1))
+  {
+    log_perr_str(LOG_ERR, "Could not open cgroup", cgroup_root, errno);
+    return false;
+  }
+  add_cgroup(-1, rootfd, cgroup_root);
+
+  // Breadth-first, so every cgroup comes after its parent.
+  for (int i = 0; i < num_cgroups && !cgroups_overflow; ++i)
+  {
+    const int fd =
+      openat(cgroups[i].dirfd, ".", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    DIR *const dir = (fd == -1) ? NULL : fdopendir(fd);
+    if (unlikely(!dir))
+    {
+      if (fd != -1) close(fd);
+      continue;
+    }
+    for (struct dirent *d = readdir(dir); d; d = readdir(dir))
+    {
+      if (d->d_type != DT_DIR || d->d_name[0] == '.') continue;
+      if (unlikely(num_cgroups == MAX_CGROUPS))
+      {
+	cgroups_overflow = true;
+	break;
+      }
+      const int sub = openat(cgroups[i].dirfd,
+	  d->d_name,
+	  O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+      if (likely(sub != -1)) add_cgroup(i, sub, d->d_name);
+    }
+    closedir(dir);
+  }
+
+#ifndef NO_CONFIG
+  if (verbose)
+  {
+    int limited = 0;
+    for (int i = 0; i < num_cgroups; ++i) if (cgroups[i].current_fd != -1)
+      ++limited;
+    logm(LOG_DEBUG,
+	"Tracking %d cgroups%s, %d with memory limits",
+	num_cgroups,
+	cgroups_overflow ? " (and more that we don't track)" : "",
+	limited);
+  }
+#endif
+  return true;
+}
+
+
+/// Take a closer look at a cgroup under pressure.  Clobbers localbuf.
+static void inspect_cgroup(struct cgroup *cg)
+{
+  struct procfield f;
+  const char *pos = localbuf;
+
+  cg->swappable = 0;
+  if (read_at(cg->dirfd, "memory.stat", localbuf, sizeof(localbuf)) > 0)
+    while (procfile_field(&pos, &f))
+      if (field_is(&f, "anon") || field_is(&f, "shmem"))
+	cg->swappable += f.value;
+
+  cg->max_events = cg->oom_kills = 0;
+  pos = localbuf;
+  if (read_at(cg->dirfd, "memory.events", localbuf, sizeof(localbuf)) > 0)
+    while (procfile_field(&pos, &f))
+    {
+      if (field_is(&f, "max")) cg->max_events = f.value;
+      else if (field_is(&f, "oom_kill")) cg->oom_kills = f.value;
+    }
+
+  cg->swap_current = 0;
+  if (cg->swap_max >= 0)
+  {
+    cg->swap_current = read_value_at(cg->dirfd, "memory.swap.current");
+    if (cg->swap_current < 0) cg->swap_current = 0;
+  }
+}
+
+
+/// Sample cgroup, and work out how much swap it wants.  Clobbers localbuf.
+static void sample_cgroup(struct cgroup *cg)
+{
+  cg->demand = 0;
+  if (cg->current_fd == -1) return;
+
+  char buf[32];
+  const ssize_t len = pread(cg->current_fd, buf, sizeof(buf)-1, 0);
+  if (unlikely(len <= 0))
+  {
+    // Most likely the cgroup has been removed.
+    cg->current = 0;
+    return;
+  }
+  buf[len] = '\0';
+  cg->current = cgroup_value(buf);
+
+  const memsize_t threshold = cg->limit/100*cgroup_pressure;
+  if (likely(cg->current < threshold)) return;
+
+  inspect_cgroup(cg);
+  memsize_t d = cg->current - threshold;
+  if (d > cg->swappable) d = cg->swappable;
+  // A budget of ours is no limit: it grows with the swap we add.
+  if (cg->swap_max >= 0 && !cg->budgeted)
+  {
+    const memsize_t room = cg->swap_max - cg->swap_current;
+    if (d > room) d = room;
+  }
+  if (d > 0) cg->demand = d;
+}
+
+
+/* Left to itself, any cgroup can fill up all of swap, so one runaway container
+ * starves the rest.  With cgroup_swap_share set, we divide that share of all
+ * swap among the budgeted cgroups, in proportion to their memory limits, and
+ * set their memory.swap.max (and memory.swap.high, at cgroup_pressure percent
+ * of that) accordingly.  Budgets are replanned whenever swap is added or
+ * removed, and whenever we rescan the hierarchy.
+ *
+ * A large hierarchy shouldn't see a storm of writes every time: budgets that
+ * changed by less than 1/16 are left alone, and only BUDGET_BATCH of them are
+ * written per tick.
+ */
+
+/// Total swap space, as last reported to cgroup_rebalance(); -1 if unknown
+static memsize_t swap_pool = -1;
+
+/// Next cgroup to look at for budget writes
+static int budget_cursor = 0;
+
+
+/// Is cgroup's swap limit far enough off its budget to be worth a write?
+static bool budget_changed(const struct cgroup *cg)
+{
+  if (cg->swap_max < 0) return true;
+  const memsize_t diff = (cg->budget > cg->swap_max) ?
+    cg->budget - cg->swap_max : cg->swap_max - cg->budget;
+  return diff > cg->budget/16 && diff >= getpagesize();
+}
+
+
+/// Work out budgets for all budgeted cgroups
+static void plan_budgets(void)
+{
+  if (!cgroup_swap_share || swap_pool < 0) return;
+
+  double weights = 0;
+  for (int i = 0; i < num_cgroups; ++i)
+    if (cgroups[i].budgeted) weights += cgroups[i].limit;
+  if (!weights) return;
+
+  const double share = (double)swap_pool/100 * cgroup_swap_share;
+  for (int i = 0; i < num_cgroups; ++i) if (cgroups[i].budgeted)
+  {
+    struct cgroup *const cg = &cgroups[i];
+    cg->budget = (memsize_t)(share * cg->limit / weights);
+    cg->budget_dirty = budget_changed(cg);
+  }
+}
+
+
+static bool write_value_at(int dirfd, const char file[], memsize_t value)
+{
+  const int fd = openat(dirfd, file, O_WRONLY|O_CLOEXEC);
+  if (fd == -1) return false;
+  char buf[32];
+  const int len = snprintf(buf, sizeof(buf), "%lld\n", value);
+  const bool ok = (write(fd, buf, len) == len);
+  close(fd);
+  return ok;
+}
+
+
+/// Write out a batch of budgets that need it
+static void write_budgets(void)
+{
+  int written = 0;
+  for (int n = 0; n < num_cgroups && written < BUDGET_BATCH; ++n)
+  {
+    struct cgroup *const cg = &cgroups[budget_cursor];
+    budget_cursor = (budget_cursor + 1) % num_cgroups;
+    if (!cg->budget_dirty) continue;
+
+    // Failure is not retried until the next replan, to avoid a flood of logs.
+    cg->budget_dirty = false;
+    ++written;
+    if (unlikely(!write_value_at(cg->dirfd, "memory.swap.max", cg->budget)))
+    {
+      log_perr_str(LOG_NOTICE,
+	  "Could not set swap budget for",
+	  cg->name,
+	  errno);
+      continue;
+    }
+    // Older kernels have no memory.swap.high.  That's fine.
+    write_value_at(cg->dirfd,
+	"memory.swap.high",
+	cg->budget/100*cgroup_pressure);
+    cg->swap_max = cg->budget;
+  }
+#ifndef NO_CONFIG
+  if (written && verbose) logm(LOG_DEBUG, "Wrote %d swap budgets", written);
+#endif
+}
+
+
+void cgroup_rebalance(memsize_t total_swap)
+{
+  if (total_swap == swap_pool) return;
+  swap_pool = total_swap;
+  plan_budgets();
+}
+
+
+memsize_t cgroup_demand(void)
+{
+  if (!cgroup_root[0]) return 0;
+
+  if (last_scan < 0 || runclock - last_scan >= CGROUP_RESCAN_INTERVAL)
+  {
+    scan_cgroups();
+    budget_cursor = 0;
+    plan_budgets();
+  }
+  if (unlikely(!num_cgroups)) return 0;
+  if (cgroup_swap_share) write_budgets();
+
+  for (int i = 0; i < num_cgroups; ++i)
+  {
+    sample_cgroup(&cgroups[i]);
+    cgroups[i].child_demand = 0;
+  }
+
+  /* Going backwards, we see all of a cgroup's descendants before the cgroup
+   * itself.  Swapping out memory of a child also relieves its parent, so when
+   * both are under pressure, it's the greater of the two that counts.
+   */
+  for (int i = num_cgroups-1; i >= 0; --i)
+  {
+    struct cgroup *const cg = &cgroups[i];
+    cg->total_demand = MAX(cg->demand, cg->child_demand);
+    if (cg->parent >= 0) cgroups[cg->parent].child_demand += cg->total_demand;
+  }
+
+  return cgroups[0].total_demand;
+}
+
+
+void dump_cgroups(void)
+{
+  if (!num_cgroups) return;
+
+  logm(LOG_INFO,
+      "cgroups: %d tracked%s; %lld bytes of swap wanted",
+      num_cgroups,
+      cgroups_overflow ? " (and more not tracked)" : "",
+      cgroups[0].total_demand);
+  if (cgroup_swap_share)
+  {
+    int budgeted = 0, pending = 0;
+    for (int i = 0; i < num_cgroups; ++i) if (cgroups[i].budgeted)
+    {
+      ++budgeted;
+      if (cgroups[i].budget_dirty) ++pending;
+    }
+    logm(LOG_INFO,
+	"swap budgets: %d%% of %lld bytes across %d cgroups; %d writes pending",
+	cgroup_swap_share,
+	swap_pool,
+	budgeted,
+	pending);
+  }
+  for (int i = 0; i < num_cgroups; ++i)
+  {
+    const struct cgroup *const cg = &cgroups[i];
+    if (cg->current_fd == -1 || cg->current < cg->limit/100*cgroup_pressure)
+      continue;
+    logm(LOG_INFO,
+	"cgroup %s: %lld of %lld used, %lld swappable, %lld swapped; "
+	"%lld at limit, %lld OOM kills; wants %lld (budget %lld)",
+	cg->name,
+	cg->current,
+	cg->limit,
+	cg->swappable,
+	cg->swap_current,
+	cg->max_events,
+	cg->oom_kills,
+	cg->demand,
+	cg->budgeted ? cg->budget : cg->swap_max);
+  }
+}
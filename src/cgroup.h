@@ -0,0 +1,65 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_CGROUP_H
+#define SWAPSPACE_CGROUP_H
+
+#include "main.h"
+#include "memory.h"
+
+/* On a container host, memory runs short inside memory cgroups long before it
+ * does globally: a container that reaches its memory.high or memory.max has to
+ * reclaim, and if it has no swap to reclaim anonymous memory to, it stalls or
+ * gets OOM-killed while the machine as a whole has plenty of memory left.
+ *
+ * If cgroup_root is set, we track the cgroup v2 hierarchy below it and work
+ * out how much swap the cgroups under pressure could use.
+ */
+
+/// Swap space wanted by memory cgroups under pressure.  Clobbers localbuf.
+/** A cgroup is under pressure once its usage reaches cgroup_pressure percent of
+ * its memory limit.  It wants enough swap to bring usage back to that point,
+ * but no more than it has anonymous and shared memory to swap out, and no more
+ * than its memory.swap.max allows.  A cgroup's demand includes that of its
+ * descendants, but a parent and child under pressure are not counted twice.
+ *
+ * Only cgroups with a memory limit are sampled on each call, and of those only
+ * the ones under pressure are looked at in any detail.  The hierarchy itself is
+ * rescanned every half minute.
+ *
+ * @return Bytes of swap wanted, or zero if none (or if cgroup_root is not set)
+ */
+memsize_t cgroup_demand(void);
+
+/// Total swap space has changed; replan per-cgroup swap budgets
+/** Budgets are written out in batches by later calls to cgroup_demand().
+ * @param total_swap All active swap space, in bytes
+ */
+void cgroup_rebalance(memsize_t total_swap);
+
+/// Log cgroups under pressure
+void dump_cgroups(void);
+
+#ifndef NO_CONFIG
+char *set_cgroup_root(long long dummy);
+char *set_cgroup_pressure(long long pct);
+char *set_cgroup_swap_share(long long pct);
+
+bool cgroup_check_config(void);
+#endif
+
+#endif
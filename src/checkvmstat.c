@@ -0,0 +1,132 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vmstat.h"
+
+// Checks parse_vmstat() against /proc/vmstat excerpts from different kernel
+// versions, whose field names differ.  Exits with failure if any comes out
+// wrong.
+
+char localbuf[16384];
+
+struct fixture
+{
+  const char *kernel;
+  const char *text;
+  struct vmstat expect;
+};
+
+static const struct fixture fixtures[] =
+{
+  {
+    "4.4: per-zone reclaim counters",
+    "pswpin 11\n"
+    "pswpout 12\n"
+    "pgmajfault 13\n"
+    "pgsteal_kswapd_dma 1\n"
+    "pgsteal_kswapd_normal 2\n"
+    "pgsteal_direct_normal 4\n"
+    "pgscan_kswapd_dma 10\n"
+    "pgscan_kswapd_normal 20\n"
+    "pgscan_direct_normal 40\n"
+    "pgscan_direct_throttle 1000\n"
+    "workingset_refault 5\n"
+    "workingset_activate 3\n"
+    "allocstall 7\n",
+    { .pgscan = 70, .pgsteal = 7, .refault = 5, .activate = 3,
+      .pswpin = 11, .pswpout = 12, .pgmajfault = 13, .allocstall = 7 }
+  },
+  {
+    "5.4: kswapd and direct totals",
+    "pswpin 11\n"
+    "pswpout 12\n"
+    "pgmajfault 13\n"
+    "pgsteal_kswapd 3\n"
+    "pgsteal_direct 4\n"
+    "pgscan_kswapd 30\n"
+    "pgscan_direct 40\n"
+    "pgscan_direct_throttle 1000\n"
+    "workingset_refault 5\n"
+    "workingset_activate 3\n"
+    "allocstall_dma 1\n"
+    "allocstall_normal 6\n",
+    { .pgscan = 70, .pgsteal = 7, .refault = 5, .activate = 3,
+      .pswpin = 11, .pswpout = 12, .pgmajfault = 13, .allocstall = 7 }
+  },
+  {
+    "5.15: file page counters",
+    "pswpin 11\n"
+    "pswpout 12\n"
+    "pgmajfault 13\n"
+    "pgsteal_kswapd 300\n"
+    "pgsteal_direct 400\n"
+    "pgsteal_file 7\n"
+    "pgscan_kswapd 3000\n"
+    "pgscan_direct 4000\n"
+    "pgscan_file 70\n"
+    "workingset_refault_anon 500\n"
+    "workingset_refault_file 5\n"
+    "workingset_activate_anon 300\n"
+    "workingset_activate_file 3\n"
+    "allocstall_normal 7\n",
+    { .pgscan = 70, .pgsteal = 7, .refault = 5, .activate = 3,
+      .pswpin = 11, .pswpout = 12, .pgmajfault = 13, .allocstall = 7 }
+  },
+};
+
+#define NUM_FIXTURES (sizeof(fixtures)/sizeof(*fixtures))
+
+
+/// Compare one counter; print it if it's wrong
+static bool check(const char kernel[],
+    const char name[],
+    memsize_t got,
+    memsize_t expect)
+{
+  if (got == expect) return true;
+  printf("%s: %s is %lld, expected %lld\n", kernel, name, got, expect);
+  return false;
+}
+
+#define CHECK(FIELD) check(fx->kernel, #FIELD, vs.FIELD, fx->expect.FIELD)
+
+
+int main(void)
+{
+  bool ok = true;
+  for (size_t i = 0; i < NUM_FIXTURES; ++i)
+  {
+    const struct fixture *const fx = &fixtures[i];
+    struct vmstat vs;
+    parse_vmstat(fx->text, &vs);
+    // Check them all, so every wrong counter gets reported.
+    ok = CHECK(pgscan) & ok;
+    ok = CHECK(pgsteal) & ok;
+    ok = CHECK(refault) & ok;
+    ok = CHECK(activate) & ok;
+    ok = CHECK(pswpin) & ok;
+    ok = CHECK(pswpout) & ok;
+    ok = CHECK(pgmajfault) & ok;
+    ok = CHECK(allocstall) & ok;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
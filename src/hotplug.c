@@ -0,0 +1,145 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "hotplug.h"
+#include "log.h"
+#include "reactor.h"
+#include "state.h"
+#include "support.h"
+
+/* The kernel announces device changes as "uevents" on a netlink socket; that's
+ * what udev listens to.  Memory is hotplugged in blocks (typically 128 MB) that
+ * show up as devices under /sys/devices/system/memory, and each block that goes
+ * online or offline gets an event of its own.  A single resize may thus come as
+ * a burst of dozens of events, so we drain the socket before acting.
+ */
+
+/// Kernel's multicast group for uevents
+#define UEVENT_GROUP 1
+
+
+/// Find "key=value" in a uevent's NUL-separated list of fields
+static const char *uevent_value(const char msg[], size_t len, const char key[])
+{
+  const size_t keylen = strlen(key);
+  for (size_t i = 0; i < len; i += strlen(msg+i) + 1)
+    if (strncmp(msg+i, key, keylen) == 0 && msg[i+keylen] == '=')
+      return msg + i + keylen + 1;
+  return NULL;
+}
+
+
+/// Is this uevent about memory going online or offline?
+static bool memory_event(const char msg[], size_t len)
+{
+  const char *const subsystem = uevent_value(msg, len, "SUBSYSTEM");
+  const char *const action = uevent_value(msg, len, "ACTION");
+  return subsystem && action &&
+    strcmp(subsystem, "memory") == 0 &&
+    (strcmp(action, "online") == 0 || strcmp(action, "offline") == 0);
+}
+
+
+/// Uevents have arrived.  Clobbers localbuf.
+static void handle_uevents(int fd, uint32_t events)
+{
+  bool resized = false;
+  for (;;)
+  {
+    struct sockaddr_nl sender;
+    socklen_t senderlen = sizeof(sender);
+    const ssize_t len = recvfrom(fd,
+	localbuf,
+	sizeof(localbuf)-1,
+	0,
+	(struct sockaddr *)&sender,
+	&senderlen);
+    if (len < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      if (errno == EINTR) continue;
+      // We missed some events.  One of them may have been about memory.
+      if (errno == ENOBUFS)
+      {
+	resized = true;
+	continue;
+      }
+      log_perr(LOG_NOTICE, "Lost memory hotplug events", errno);
+      reactor_unwatch(fd);
+      close(fd);
+      break;
+    }
+    // Only the kernel itself gets to tell us about hardware.
+    if (unlikely(sender.nl_pid != 0)) continue;
+    localbuf[len] = '\0';
+    if (memory_event(localbuf, (size_t)len)) resized = true;
+  }
+
+  if (resized)
+  {
+#ifndef NO_CONFIG
+    if (verbose) logm(LOG_DEBUG, "Memory hotplugged or unplugged");
+#endif
+    handle_hotplug();
+  }
+}
+
+
+bool hotplug_start(void)
+{
+  const int fd = socket(AF_NETLINK,
+      SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC,
+      NETLINK_KOBJECT_UEVENT);
+  if (unlikely(fd == -1))
+  {
+#ifndef NO_CONFIG
+    if (verbose) log_perr(LOG_DEBUG, "No memory hotplug events", errno);
+#endif
+    return false;
+  }
+
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = UEVENT_GROUP;
+  if (unlikely(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1))
+  {
+    log_perr(LOG_NOTICE, "Could not listen for memory hotplug events", errno);
+    close(fd);
+    return false;
+  }
+
+  if (unlikely(!reactor_watch(fd, EPOLLIN, handle_uevents)))
+  {
+    close(fd);
+    return false;
+  }
+#ifndef NO_CONFIG
+  if (verbose) logm(LOG_DEBUG, "Listening for memory hotplug events");
+#endif
+  return true;
+}
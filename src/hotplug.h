@@ -0,0 +1,33 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_HOTPLUG_H
+#define SWAPSPACE_HOTPLUG_H
+
+#include "main.h"
+
+/// Listen for the kernel's memory hotplug events, if we can
+/** When a block of memory goes online or offline, the reactor calls
+ * handle_hotplug().  Balloon drivers don't announce themselves this way; their
+ * doings show up as changes in memory size on the next tick.  Failure to listen
+ * is not an error.
+ *
+ * @return Whether we are listening
+ */
+bool hotplug_start(void);
+
+#endif
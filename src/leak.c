@@ -0,0 +1,364 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/param.h>
+
+#include "leak.h"
+#include "log.h"
+#include "snapshot.h"
+#include "support.h"
+
+
+/// Configuration item: a process causing n% of memory growth is leaking
+/** Zero disables leak detection.
+ */
+static int leak_share = 0;
+
+/// Configuration item: command to run when a leaking process is spotted
+/** Empty for none.  It is run in the background, with the process identifier
+ * and the process's growth in bytes as arguments.
+ */
+static char leak_hook[PATH_MAX] = "";
+
+#ifndef NO_CONFIG
+char *set_leak_share(long long pct)
+{
+  leak_share = (int)pct;
+  return NULL;
+}
+char *set_leak_hook(long long dummy)
+{
+  return leak_hook;
+}
+#endif
+
+
+/// Most processes we track at a time
+#define LEAK_TRACKED 256
+
+/// Processes to look at per call to leak_scan()
+/** Each takes an open, read and close of its status file.  On a host with ten
+ * thousand processes, a full sweep takes a few minutes at the default pace.
+ */
+#define LEAK_BATCH 64
+
+/// Growth older than this (in seconds) is gradually forgotten
+#define LEAK_WINDOW 3600
+
+/// Growth is sustained once seen on this many visits to a process...
+/** ...without as many visits in a row in between that saw no growth.  A leaking
+ * process stops being one once that many visits in a row see no growth.
+ */
+#define LEAK_VISITS 3
+
+struct tracked
+{
+  pid_t pid;
+  /// Process name, to tell whether a process identifier has been reused
+  char name[16];
+  /// Anonymous memory plus swap, in bytes, as last seen
+  memsize_t footprint;
+  /// Footprint at base_time
+  memsize_t base;
+  /// Memory usage of the whole system at base_time
+  memsize_t base_used;
+  /// When we started counting this process's growth
+  time_t base_time;
+  /// Number of the last sweep that saw this process
+  unsigned sweep;
+  /// Visits that saw growth lately, and visits in a row that saw none
+  int rises, stalls;
+};
+
+static struct tracked tracked[LEAK_TRACKED];
+static int num_tracked = 0;
+
+/// Our open /proc, or NULL
+static DIR *proc_dir = NULL;
+/// Number of the current sweep through /proc
+static unsigned sweep = 0;
+
+/// Memory usage of the whole system (memory and swap) at the latest scan
+static memsize_t used_now = 0;
+
+/// The leaking process, if any, or -1
+static int culprit = -1;
+
+
+/// Process's growth since base_time
+static inline memsize_t growth(const struct tracked *t)
+{
+  return t->footprint - t->base;
+}
+
+/// Percentage of the system's growth since base_time caused by the process
+static int share(const struct tracked *t)
+{
+  const memsize_t total = used_now - t->base_used;
+  if (total <= 0 || growth(t) <= 0) return 0;
+  return (growth(t) >= total) ? 100 : (int)(100*growth(t)/total);
+}
+
+
+/// Find value of field in /proc/<pid>/status, e.g. "\nVmSwap:\t  123 kB"
+static memsize_t status_field(const char status[], const char field[])
+{
+  const char *const p = strstr(status, field);
+  if (!p) return -1;
+  return strtoll(p + strlen(field), NULL, 10) * KILO;
+}
+
+
+/// Read process's name and footprint.  Clobbers localbuf.
+/**
+ * @return Footprint in bytes, or -1 if not available (e.g. kernel threads)
+ */
+static memsize_t read_status(pid_t pid, char name[16])
+{
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+  const int fd = open(path, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) return -1;
+  const ssize_t len = read(fd, localbuf, sizeof(localbuf)-1);
+  close(fd);
+  if (len <= 0) return -1;
+  localbuf[len] = '\0';
+
+  const memsize_t anon = status_field(localbuf, "\nRssAnon:"),
+		  swap = status_field(localbuf, "\nVmSwap:");
+  if (anon < 0) return -1;
+
+  // The first line is "Name:\t<name>"
+  const char *const n = localbuf + strlen("Name:\t");
+  const size_t namelen = strcspn(n, "\n");
+  memset(name, 0, 16);
+  memcpy(name, n, MIN(namelen, 15));
+  return anon + MAX(swap, 0);
+}
+
+
+/// Start tracking a process, if there's room or it's larger than another one
+static void track(pid_t pid, const char name[16], memsize_t footprint)
+{
+  struct tracked *t = NULL;
+  if (num_tracked < LEAK_TRACKED)
+  {
+    t = &tracked[num_tracked++];
+  }
+  else
+  {
+    for (int i = 0; i < num_tracked; ++i)
+      if (i != culprit &&
+	  tracked[i].footprint < footprint &&
+	  (!t || tracked[i].footprint < t->footprint))
+	t = &tracked[i];
+    if (!t) return;
+  }
+  t->pid = pid;
+  memcpy(t->name, name, 16);
+  t->footprint = t->base = footprint;
+  t->base_used = used_now;
+  t->base_time = runclock;
+  t->sweep = sweep;
+  t->rises = t->stalls = 0;
+}
+
+
+/// Update process's figures, whether we track it already or not
+static void visit(pid_t pid, memsize_t floor)
+{
+  char name[16];
+  const memsize_t footprint = read_status(pid, name);
+  if (footprint < 0) return;
+
+  int i;
+  for (i = 0; i < num_tracked && tracked[i].pid != pid; ++i);
+  if (i == num_tracked)
+  {
+    if (footprint >= floor) track(pid, name, footprint);
+    return;
+  }
+
+  struct tracked *const t = &tracked[i];
+  if (strcmp(t->name, name) != 0 || footprint < t->base)
+  {
+    // A new process by the same number, or this one has shrunk.  Start over.
+    memcpy(t->name, name, 16);
+    t->base = footprint;
+    t->base_used = used_now;
+    t->base_time = runclock;
+    t->rises = t->stalls = 0;
+  }
+  else if (runclock - t->base_time > LEAK_WINDOW)
+  {
+    // Forget half of the old growth.
+    t->base += growth(t) / 2;
+    t->base_used += (used_now - t->base_used) / 2;
+    t->base_time = runclock - LEAK_WINDOW/2;
+  }
+  if (footprint > t->footprint)
+  {
+    ++t->rises;
+    t->stalls = 0;
+  }
+  else if (++t->stalls >= LEAK_VISITS)
+  {
+    t->rises = 0;
+  }
+  t->footprint = footprint;
+  t->sweep = sweep;
+}
+
+
+/// A sweep through /proc is done; forget processes it didn't find
+static void end_sweep(void)
+{
+  int kept = 0;
+  for (int i = 0; i < num_tracked; ++i) if (tracked[i].sweep == sweep)
+  {
+    if (culprit == i) culprit = kept;
+    if (kept != i) tracked[kept] = tracked[i];
+    ++kept;
+  }
+  else if (culprit == i)
+  {
+    logm(LOG_NOTICE,
+	"Leaking process %d (%s) is gone",
+	(int)tracked[i].pid,
+	tracked[i].name);
+    culprit = -1;
+  }
+  num_tracked = kept;
+  ++sweep;
+  rewinddir(proc_dir);
+}
+
+
+/// Report a newly spotted leaking process.  Clobbers localbuf.
+static void report(const struct tracked *t)
+{
+  logm(LOG_WARNING,
+      "Process %d (%s) grew by %lld bytes in %ld s, %d%% of all growth; "
+      "not adding swap space",
+      (int)t->pid,
+      t->name,
+      growth(t),
+      (long)(runclock - t->base_time),
+      share(t));
+  if (!leak_hook[0]) return;
+
+  char args[64];
+  snprintf(args, sizeof(args), "%d %lld", (int)t->pid, growth(t));
+  if (runcommandformat("%s %s &", leak_hook, args) == -1)
+    log_perr_str(LOG_ERR, "Could not run leak hook", leak_hook, errno);
+}
+
+
+/// Find the process that accounts for most growth, if any
+static void judge(memsize_t min_growth)
+{
+  int worst = -1;
+  for (int i = 0; i < num_tracked; ++i)
+  {
+    const struct tracked *const t = &tracked[i];
+    const bool sustained = (i == culprit) ?
+      (t->stalls < LEAK_VISITS) :
+      (t->rises >= LEAK_VISITS);
+    if (sustained &&
+	growth(t) >= min_growth &&
+	share(t) >= leak_share &&
+	(worst == -1 || growth(t) > growth(&tracked[worst])))
+      worst = i;
+  }
+
+  if (worst == culprit) return;
+  if (worst == -1)
+  {
+    logm(LOG_NOTICE,
+	"Process %d (%s) no longer looks like it's leaking",
+	(int)tracked[culprit].pid,
+	tracked[culprit].name);
+  }
+  culprit = worst;
+  if (culprit != -1) report(&tracked[culprit]);
+}
+
+
+void leak_scan(const struct snapshot *snap)
+{
+  if (!leak_share) return;
+  if (!proc_dir)
+  {
+    proc_dir = opendir("/proc");
+    if (unlikely(!proc_dir))
+    {
+      log_perr(LOG_ERR, "Cannot watch for leaking processes", errno);
+      leak_share = 0;
+      return;
+    }
+  }
+
+  used_now = snap->space_total - snap->space_free;
+  const memsize_t floor = snap->space_total / 100;
+  for (int n = 0; n < LEAK_BATCH; )
+  {
+    const struct dirent *const d = readdir(proc_dir);
+    if (!d)
+    {
+      end_sweep();
+      break;
+    }
+    if (d->d_name[0] < '1' || d->d_name[0] > '9') continue;
+    visit((pid_t)atoi(d->d_name), floor);
+    ++n;
+  }
+
+  // Growth only counts if it's sustained: two hundredths of memory and swap.
+  judge(snap->space_total / 50);
+}
+
+
+bool leak_capped(void)
+{
+  return culprit != -1;
+}
+
+
+void dump_leak(void)
+{
+  for (int i = 0; i < num_tracked; ++i)
+    logm(LOG_INFO,
+	"process %d (%s): %lld anon+swap, %+lld in %ld s (%d%% of growth)%s",
+	(int)tracked[i].pid,
+	tracked[i].name,
+	tracked[i].footprint,
+	growth(&tracked[i]),
+	(long)(runclock - tracked[i].base_time),
+	share(&tracked[i]),
+	(i == culprit) ? "; leaking" : "");
+}
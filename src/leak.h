@@ -0,0 +1,52 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_LEAK_H
+#define SWAPSPACE_LEAK_H
+
+#include "main.h"
+#include "memory.h"
+
+struct snapshot;
+
+/* A process that leaks memory will take all the swap space we give it.  If we
+ * keep allocating, the disk fills up and the whole system suffers; better to
+ * let that one process run into the OOM killer.  So if leak_share is set, we
+ * keep an eye on how much anonymous memory and swap each large process uses,
+ * and once a single process accounts for most of the growth in memory usage,
+ * we stop adding swap space.
+ */
+
+/// Look at another batch of processes.  Clobbers localbuf.
+/** Processes are visited a batch at a time, so a full sweep of /proc on a busy
+ * host takes a number of calls.  Only processes using at least a hundredth of
+ * memory and swap are tracked.  Does nothing if leak_share is not set.
+ */
+void leak_scan(const struct snapshot *snap);
+
+/// Has a leaking process been spotted, so we should not add swap space?
+bool leak_capped(void);
+
+/// Log tracked processes
+void dump_leak(void);
+
+#ifndef NO_CONFIG
+char *set_leak_hook(long long dummy);
+char *set_leak_share(long long pct);
+#endif
+
+#endif
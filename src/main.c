@@ -32,26 +32,32 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/epoll.h>
 #include <sys/param.h>
+#include <sys/signalfd.h>
 #include <sys/types.h>
 
 #include <fcntl.h>
 #include <unistd.h>
 
 #include "config.h"
+#include "hotplug.h"
 #include "log.h"
 #include "main.h"
 #include "memory.h"
 #include "opts.h"
+#include "pace.h"
+#include "psi.h"
+#include "reactor.h"
+#include "snapshot.h"
 #include "state.h"
 #include "support.h"
 #include "swaps.h"
+#include "tmpfs.h"
 
 char localbuf[16384];
 time_t runclock = 0;
-
-/// Have we received a kill/HUP/power signal?
-static volatile bool stop = false;
+sigset_t original_sigmask;
 
 static char pidfile[PATH_MAX] = "/var/run/swapspace.pid";
 static bool make_pidfile = false;
@@ -156,16 +162,6 @@ static bool startpidfile(void)
 }
 
 
-/// Signal handler that requests clean exit
- /*
-  * doc/unix-ipc-sucks.md
- */
-static void sighand_exit(int sig)
-{
-  stop = true;
-}
-
-
 /// Write process id to pidfile if requested, and close it.  Clobbers localbuf.
 /**
  * @return Success (which is trivially achieved if no pidfile is requested)
@@ -189,66 +185,112 @@ static pid_t daemonize(void)
 }
 
 
-/// Was a dump of statistics requested?
-static volatile bool print_status=false;
-
-/// Was an immediate adjustment requested?
-static volatile bool adjust_swap=false;
+/// Signals we handle, as events in the central loop
+/** Rather than having handlers set flags for us (see doc/unix-ipc-sucks.md), we
+ * block these signals and read them from a signalfd.  They can arrive whenever
+ * they like; we deal with them as soon as we're not busy.
+ */
+static sigset_t handled_sigs;
 
 
-/// Signal handler that requests generation of a status report to stdout
-static void sighand_status(int sig)
+/// Install signal handling
+static void install_sigs(void)
 {
-  print_status = true;
+#ifdef SIGXFSZ
+  // Some systems may send signal if our swapfiles get too large, but we have
+  // our own ways of dealing with that eventuality.  Ignore the signal.
+  signal(SIGXFSZ, SIG_IGN);
+#endif
+
+  sigemptyset(&handled_sigs);
+
+  // Exit requests
+  sigaddset(&handled_sigs, SIGTERM);
+  sigaddset(&handled_sigs, SIGHUP);
+#ifdef SIGPWR
+  sigaddset(&handled_sigs, SIGPWR);
+#endif
+
+  // Status dump and immediate adjustment
+  sigaddset(&handled_sigs, SIGUSR1);
+  sigaddset(&handled_sigs, SIGUSR2);
+
+  // Block them right away, so any that arrive before we start our central loop
+  // stay pending until we're ready for them.
+  sigprocmask(SIG_BLOCK, &handled_sigs, &original_sigmask);
 }
 
-/// Signal handler that initiates immediate swapspace adjustment
-static void sighand_diet(int sig)
+
+/// Handle incoming signal(s)
+static void handle_signal(int fd, uint32_t events)
 {
-  adjust_swap = true;
+  struct signalfd_siginfo si;
+  while (read(fd, &si, sizeof(si)) == sizeof(si)) switch (si.ssi_signo)
+  {
+  case SIGUSR1:
+    // Generate a status report to stdout
+    dump_stats();
+    break;
+  case SIGUSR2:
+    // Initiate immediate swapspace adjustment
+    request_diet();
+    break;
+  default:
+    // Clean exit
+    reactor_stop();
+    break;
+  }
 }
 
 
-static void install_sighandler(int signum, void (*handler)(int))
+/// Current interval between iterations, in milliseconds
+static int tick_msecs = 1000;
+
+/// Perform one iteration of the allocation algorithm, and pace the next one
+static void handle_tick(void)
 {
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = handler;
-  sigaction(signum, &sa, NULL);
+  handle_requirements();
+
+  const int next = pace_interval();
+  if (next != tick_msecs && likely(reactor_tick(next, handle_tick)))
+    tick_msecs = next;
 }
 
 
-/// Install signal handlers
-static void install_sigs(void)
+/// Set up our central loop and its event sources
+static bool start_events(void)
 {
-#ifdef SIGXFSZ
-  // Some systems may send signal if our swapfiles get too large, but we have
-  // our own ways of dealing with that eventuality.  Ignore the signal.
-  signal(SIGXFSZ, SIG_IGN);
-#endif
+  if (unlikely(!reactor_start())) return false;
 
-  // Install exit handler.  These may not be repeatable, i.e. if the same signal
-  // comes in again, we will probably just be terminated.  But that's not
-  // unreasonable, come to think of it.
-  signal(SIGTERM, sighand_exit);
-  signal(SIGHUP, sighand_exit);
-#ifdef SIGPWR
-  signal(SIGPWR, sighand_exit);
-#endif
+  const int sigfd = signalfd(-1, &handled_sigs, SFD_NONBLOCK|SFD_CLOEXEC);
+  if (unlikely(sigfd == -1))
+  {
+    log_perr(LOG_ERR, "Could not set up signal handling", errno);
+    return false;
+  }
 
-  // These handlers must be repeatable.
-  install_sighandler(SIGUSR1, sighand_status);
-  install_sighandler(SIGUSR2, sighand_diet);
+  if (unlikely(!reactor_watch(sigfd, EPOLLIN, handle_signal)) ||
+      unlikely(!reactor_tick(tick_msecs, handle_tick)))
+    return false;
+
+  psi_start();
+  tmpfs_start();
+  hotplug_start();
+  return true;
 }
 
 
 bool swapfs_large_enough(void)
 {
-  const memsize_t minswapfile = minimal_swapfile();
+  struct snapshot snap;
+  if (unlikely(!sample_memory(&snap, true))) return false;
 
-  if (minswapfile == MEMSIZE_ERROR) return false;
+  const memsize_t minswapfile = minimal_swapfile(&snap.mem);
 
-  if (swapfs_size() < minswapfile)
+  memsize_t fsfree, fssize;
+  if (unlikely(!swapfs_stat(&fsfree, &fssize))) return false;
+
+  if (fssize < minswapfile)
   {
     logm(LOG_CRIT, 
 	"The filesystem holding swapspace's swap directory isn't big enough "
@@ -260,7 +302,7 @@ bool swapfs_large_enough(void)
     return false;
   }
 
-  if (swapfs_free() < minswapfile)
+  if (fsfree < minswapfile)
     logm(LOG_WARNING,
 	"Not enough free space on swap directory.  As things stand now, "
 	"swapspace will not be able to create swap files.");
@@ -292,6 +334,7 @@ int main(int argc, char *argv[])
   if (erase) return retire_all() ? EXIT_SUCCESS : EXIT_FAILURE;
 
   install_sigs();
+  reactor_init();
 
   if (unlikely(!startpidfile())) return EXIT_FAILURE;
 
@@ -349,16 +392,9 @@ int main(int argc, char *argv[])
   }
 
   // Central loop
-  for (++runclock; !stop; ++runclock)
-  {
-    if (unlikely(print_status))		print_status = false,	dump_stats();
-    else if (unlikely(adjust_swap))	adjust_swap = false,	request_diet();
-    else 			        handle_requirements();
-
-    sleep(1);
-  }
-
   int result = EXIT_SUCCESS;
+  if (unlikely(!start_events()) || unlikely(!reactor_run()))
+    result = EXIT_FAILURE;
 
 #ifndef NO_CONFIG
   /* If we're worried about attackers getting unguarded access to the disk, we
@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #ifndef SWAPSPACE_MAIN_H
 #define SWAPSPACE_MAIN_H
 
+#include <signal.h>
 #include <time.h>
 
 /// I thought C99 had this built in... Maybe I'm doing something wrong.
@@ -43,9 +44,15 @@ enum { false=0, true=1 };
  */
 extern char localbuf[16384];
 
-/// Timestamp counter
+/// Timestamp counter: seconds since startup, including any time suspended
 extern time_t runclock;
 
+/// Signal mask we were started with
+/** We block the signals we handle, so they can be read from a signalfd.  The
+ * commands we run must not inherit that.
+ */
+extern sigset_t original_sigmask;
+
 /// Is the swapdir on a filesystem large enough for useful swap files?
 /** Also prints a warning if the filesystem is large enough, but does not have
  * sufficient free space (but does not fail in that case).
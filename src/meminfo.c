@@ -0,0 +1,109 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "meminfo.h"
+
+/// Where to store a /proc/meminfo field in struct memstate
+struct meminfo_field
+{
+  const char *name;
+  size_t offset;
+};
+
+#define MEMINFO_HASH_SIZE 64
+
+/// Perfect hash function for the /proc/meminfo fields we read
+/** Multipliers were found by brute-force search, so that none of the fields we
+ * read now, or are likely to want in the future, collide.  If you add a field
+ * and the build fails on a duplicate case value, find new multipliers.  Fields
+ * we don't read may collide at will; lookup compares names anyway.
+ */
+#define MEMINFO_HASH(len, second, last) \
+  ((8*(len) + 6*(unsigned char)(second) + 5*(unsigned char)(last)) % \
+   MEMINFO_HASH_SIZE)
+
+static inline unsigned meminfo_hash(const char name[], size_t len)
+{
+  return MEMINFO_HASH(len, name[1], name[len-1]);
+}
+
+/// The /proc/meminfo fields we read, with their second and last characters
+/** C can't take a string literal apart at compile time, so the characters that
+ * meminfo_hash() looks at are spelled out here.  That lets the compiler work
+ * out each field's hash slot, and refuse to build if two fields collide.
+ */
+#define MEMINFO_FIELDS(F) \
+  F(Buffers, 'u', 's') \
+  F(Cached, 'a', 'd') \
+  F(CommitLimit, 'o', 't') \
+  F(Committed_AS, 'o', 'S') \
+  F(Dirty, 'i', 'y') \
+  F(HugePages_Total, 'u', 'l') \
+  F(Hugepagesize, 'u', 'e') \
+  F(Hugetlb, 'u', 'b') \
+  F(KernelStack, 'e', 'k') \
+  F(MemAvailable, 'e', 'e') \
+  F(MemFree, 'e', 'e') \
+  F(MemTotal, 'e', 'l') \
+  F(Mlocked, 'l', 'd') \
+  F(PageTables, 'a', 's') \
+  F(Shmem, 'h', 'm') \
+  F(SReclaimable, 'R', 'e') \
+  F(SUnreclaim, 'U', 'm') \
+  F(SwapCached, 'w', 'd') \
+  F(SwapFree, 'w', 'e') \
+  F(SwapTotal, 'w', 'l') \
+  F(Unevictable, 'n', 'e') \
+  F(Writeback, 'r', 'k')
+
+#define MEMINFO_SLOT(NAME, second, last) \
+  MEMINFO_HASH(sizeof(#NAME)-1, second, last)
+
+#define MEMINFO_FIELD(NAME, second, last) \
+  [MEMINFO_SLOT(NAME, second, last)] = \
+    { #NAME, offsetof(struct memstate, NAME) },
+
+/// Fields we read from /proc/meminfo, indexed by meminfo_hash()
+static const struct meminfo_field meminfo_fields[MEMINFO_HASH_SIZE] =
+{
+  MEMINFO_FIELDS(MEMINFO_FIELD)
+};
+
+#define MEMINFO_CASE(NAME, second, last) \
+  case MEMINFO_SLOT(NAME, second, last):
+
+/// Never called; fails to compile if two fields share a hash slot
+static inline void meminfo_slots_distinct(int slot)
+{
+  switch (slot) { MEMINFO_FIELDS(MEMINFO_CASE) break; }
+}
+
+
+memsize_t *meminfo_member(struct memstate *st, const char name[], size_t len)
+{
+  const struct meminfo_field *const mf =
+    &meminfo_fields[meminfo_hash(name, len)];
+
+  if (!mf->name || strncmp(mf->name, name, len) != 0 || mf->name[len])
+    return NULL;
+  return (memsize_t *)((char *)st + mf->offset);
+}
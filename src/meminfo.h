@@ -0,0 +1,35 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_MEMINFO_H
+#define SWAPSPACE_MEMINFO_H
+
+#include <stddef.h>
+
+#include "main.h"
+#include "memory.h"
+
+/// Find the member of st that a /proc/meminfo field goes into
+/** Lookup is a single probe into a perfect hash table.
+ *
+ * @param name Field name; need not be nul-terminated
+ * @param len Length of name
+ * @return Pointer into st, or NULL if we don't read this field
+ */
+memsize_t *meminfo_member(struct memstate *st, const char name[], size_t len);
+
+#endif
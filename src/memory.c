@@ -21,52 +21,98 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 */
 #include "env.h"
 
-#include <assert.h>
-#include <ctype.h>
-#include <errno.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <sys/param.h>
+#include <sys/sysinfo.h>
+
+#include "cgroup.h"
+#include "leak.h"
 #include "log.h"
+#include "meminfo.h"
 #include "memory.h"
+#include "numa.h"
 #include "opts.h"
+#include "pid.h"
+#include "policy.h"
+#include "procfile.h"
+#include "snapshot.h"
 #include "support.h"
+#include "swaps.h"
+#include "thrash.h"
+#include "tmpfs.h"
+#include "trend.h"
+#include "vmstat.h"
+#include "zoneinfo.h"
+
+
+/// Lower bound to memory/swap space kept available
+static struct limit lower_freelimit = { 2000, -1 };
+/// Upper bound to memory/swap space kept available
+static struct limit upper_freelimit = { 6000, -1 };
 
+/// Configuration item: target available space after adding swap
+static struct limit freetarget = { 3000, -1 };
 
-/// Lower bound to percentage of memory/swap space kept available
-static int lower_freelimit=20;
-/// Upper bound to percentage of memory/swap space kept available
-static int upper_freelimit=60;
+/// Configuration item: commit headroom to keep under strict overcommit
+/** Relative to CommitLimit.  Only used when vm.overcommit_memory is 2.
+ */
+static struct limit commit_headroom = { 1000, -1 };
 
-/// Configuration item: target percentage of available space after adding swap
-static int freetarget=30;
+/// Configuration item: keep free swap for n% of shared memory; 0 disables
+static int tmpfs_swap = 0;
 
 /// Configuration item: what percentage of buffer space do we consider "free"?
 static int buffer_elasticity=30;
 
-// TODO: Make this adaptive based on actual cache usage, to avoid thrashing?
-// TODO: Any way of detecting actual cache flexibility or minimum size?
 /// Configuration item: what percentage of cache space do we consider "free"?
 static int cache_elasticity=80;
 
+/// Configuration item: how far learned elasticities may stray from configured
+/** In percentage points.  Zero disables learning.
+ */
+static int elasticity_range=50;
+
 // Track whether MemAvailable is present in /proc/meminfo
 static bool kernel_mem_available = false;
 
+/// Configuration item: derive lower limit from the kernel's zone watermarks?
+static bool watermark_policy = false;
+
+/// Configuration item: take full sample within n% of either freelimit
+/** Zero disables the sysinfo() fast path; we always read /proc/meminfo.
+ */
+static int fastpath_margin = 5;
+
+/// Configuration item: allocate only if needed throughout last n milliseconds
+static int alloc_window = 1500;
+/// Configuration item: free only if in excess throughout last n milliseconds
+static int free_window = 30000;
+
 #ifndef NO_CONFIG
-char *set_freetarget(long long pct)
+char *set_freetarget(long long dummy)
 {
-  freetarget = (int)pct;
-  return NULL;
+  return (char *)&freetarget;
 }
-char *set_lower_freelimit(long long pct)
+char *set_commit_headroom(long long dummy)
 {
-  lower_freelimit = (int)pct;
-  return NULL;
+  return (char *)&commit_headroom;
 }
-char *set_upper_freelimit(long long pct)
+char *set_lower_freelimit(long long dummy)
 {
-  upper_freelimit = (int)pct;
+  return (char *)&lower_freelimit;
+}
+char *set_upper_freelimit(long long dummy)
+{
+  return (char *)&upper_freelimit;
+}
+char *set_tmpfs_swap(long long pct)
+{
+  tmpfs_swap = (int)pct;
   return NULL;
 }
 char *set_buffer_elasticity(long long pct)
@@ -79,203 +125,69 @@ char *set_cache_elasticity(long long pct)
   cache_elasticity = (int)pct;
   return NULL;
 }
-
-bool memory_check_config(void)
+char *set_elasticity_range(long long pct)
 {
-  CHECK_CONFIG_ERR(lower_freelimit > upper_freelimit);
-  CHECK_CONFIG_ERR(freetarget < lower_freelimit);
-  CHECK_CONFIG_ERR(freetarget > upper_freelimit);
-  return true;
+  elasticity_range = (int)pct;
+  return NULL;
 }
-#endif
-
-
-struct meminfo_item
+char *set_watermarks(long long dummy)
 {
-  char entry[200];
-  memsize_t value;
-};
-
+  watermark_policy = true;
+  return NULL;
+}
+char *set_fastpath_margin(long long pct)
+{
+  fastpath_margin = (int)pct;
+  return NULL;
+}
+char *set_alloc_window(long long msecs)
+{
+  alloc_window = (int)msecs;
+  return NULL;
+}
+char *set_free_window(long long msecs)
+{
+  free_window = (int)msecs;
+  return NULL;
+}
 
-/// Read and parse next line from /proc/meminfo.  Clobbers localbuf.
-/** Attempt to read a line from /proc/meminfo into result.  If an error occurs,
- * result will hold errno (which may be zero, e.g. in the case of a parse error)
- * and a generic error string.  If end-of-file has been reached or a meaningless
- * line has been read, result will contain zero and the empty string.
- *
- * @return success (not EOF and not error)
+/// Is limit a no greater than limit b, as far as we can tell?
+/** A percentage can't be compared to a size without knowing the total.
  */
-static bool read_meminfo_item(FILE *fp, struct meminfo_item *result)
+static bool limits_ordered(const struct limit *a, const struct limit *b)
 {
-  result->entry[0] = '\0';
-  result->value = 0;
-  if (unlikely(!fgets(localbuf, sizeof(localbuf), fp)))
-  {
-    if (unlikely(ferror(fp))) result->value = (memsize_t)errno;
-    if (unlikely(result->value))
-      strcpy(result->entry, "Error reading /proc/meminfo");
+  if (a->hundredths >= 0 && b->hundredths >= 0 && a->hundredths > b->hundredths)
     return false;
-  }
-
-  char fact[20];
-  const int x = sscanf(localbuf,
-      "%[^:]: %lld %19s",
-      result->entry,
-      &result->value,
-      fact);
-
-  if (unlikely(x == 2))
-  {
-    // Since Linux 2.6.18-mm4 or so, /proc/meminfo may contain lines without a
-    // unit or "factor" attached.
-    fact[0] = '\0';
-  }
-  else if (unlikely(x < 2))
-  {
-    result->value = 0;
-
-    // In Linux 2.4, /proc/meminfo starts with a header line with leading
-    // whitespace.  We accept that as a special case.
-    if (likely(isspace(localbuf[0])))
-    {
-      result->entry[0] = '\0';
-      return true;
-    }
-
-    // All other parse failures are fatal.
-    snprintf(result->entry,
-	  sizeof(result->entry),
-	  "Parse error in /proc/meminfo: '%150s'",
-	  localbuf);
-
-    return false;
-  }
-
-  // Another special case for Linux 2.4: two extra lines summarize the various
-  // pools of physical memory and swap space.  We'd fail to parse these lines
-  // (which we're not interested in anyway) because there's a number where we
-  // expect a scale factor.  Detect this and skip those lines.
-  if (isdigit(fact[0]))
-  {
-    result->entry[0] = '\0';
-    result->value = 0;
-    return true;
-  }
-
-  // Parse scale factor at end of line.  I've never seen it be anything other
-  // than "kB", but who knows what can happen...
-  memsize_t scale = 0;
-  const size_t factlen = strlen(fact);
-  switch (factlen)
-  {
-  case 0:
-    scale = 1;
-    break;
-  case 3:
-    if (fact[1] != 'i') break;
-    // FALL-THROUGH
-  case 2:
-    if (fact[factlen-1] != 'B') break;
-    // FALL-THROUGH
-  case 1:
-    switch (tolower(fact[0]))
-    {
-    case 'b': scale = 1;    break;
-    case 'k': scale = KILO; break;
-    case 'm': scale = MEGA; break;
-    case 'g': scale = GIGA; break;
-    }
-    break;
-  }
-
-  if (unlikely(!scale))
-  {
-    result->value = 0;
-    snprintf(result->entry,
-	sizeof(result->entry),
-	"Unknown scale factor in /proc/meminfo: %s",
-	fact);
+  if (a->bytes >= 0 && b->bytes >= 0 && a->bytes > b->bytes)
     return false;
-  }
-
-  result->value *= scale;
   return true;
 }
 
-
-struct memstate
-{
-  memsize_t MemTotal,
-	    MemFree,
-	    MemAvailable,
-	    Buffers,
-	    Cached,
-	    Dirty,
-	    Writeback,
-	    SwapCached,
-	    SwapTotal,
-	    SwapFree,
-	    Shmem;
-};
-
-
-void imbibe_meminfo_entry(const struct meminfo_item *inf, struct memstate *st)
+bool memory_check_config(void)
 {
-  switch (inf->entry[0])
-  {
-  case 'B':
-    if (strcmp(inf->entry, "Buffers")==0)         st->Buffers = inf->value;
-    break;
-  case 'C':
-    if (strcmp(inf->entry, "Cached")==0)          st->Cached = inf->value;
-    break;
-  case 'D':
-    if (strcmp(inf->entry, "Dirty")==0)           st->Dirty = inf->value;
-    break;
-  case 'M':
-    if (strncmp(inf->entry,"Mem",3) == 0)
-    {
-      if (strcmp(inf->entry+3, "Total")==0)       st->MemTotal = inf->value;
-      else if (strcmp(inf->entry+3, "Free")==0)   st->MemFree = inf->value;
-      else if (strcmp(inf->entry+3, "Available")==0)
-      {
-        kernel_mem_available = true;
-        st->MemAvailable = inf->value;
-      }
-    }
-    break;
-  case 'S':
-    if (strncmp(inf->entry,"Swap",4) == 0)
-    {
-      if (strcmp(inf->entry+4, "Total")==0)       st->SwapTotal = inf->value;
-      else if (strcmp(inf->entry+4, "Free")==0)   st->SwapFree = inf->value;
-      else if (strcmp(inf->entry+4, "Cached")==0) st->SwapCached = inf->value;
-    }
-    if (strcmp(inf->entry,"Shmem")==0)            st->Shmem = inf->value;
-    break;
-  case 'W':
-    if (strcmp(inf->entry,"Writeback")==0)        st->Writeback = inf->value;
-    break;
-  }
+  CHECK_CONFIG_ERR(!limits_ordered(&lower_freelimit, &upper_freelimit));
+  CHECK_CONFIG_ERR(!limits_ordered(&lower_freelimit, &freetarget));
+  CHECK_CONFIG_ERR(!limits_ordered(&freetarget, &upper_freelimit));
+  return true;
 }
+#endif
+
 
+static struct procfile proc_meminfo = PROCFILE("/proc/meminfo");
 
+/// Sample /proc/meminfo.  Clobbers localbuf.
 static bool read_proc_meminfo(struct memstate *s)
 {
-  FILE *fp = fopen("/proc/meminfo", "r");
-  if (unlikely(!fp))
-  {
-    log_perr(LOG_ERR, "Could not open /proc/meminfo for reading", errno);
-    return false;
-  }
+  if (unlikely(procfile_read(&proc_meminfo) < 0)) return false;
 
-  struct meminfo_item inf;
-  while (read_meminfo_item(fp, &inf)) imbibe_meminfo_entry(&inf, s);
-  fclose(fp);
-  if (unlikely(inf.entry[0]))
+  const char *pos = localbuf;
+  struct procfield f;
+  while (procfile_field(&pos, &f))
   {
-    log_perr(LOG_ERR, inf.entry, inf.value);
-    return false;
+    memsize_t *const member = meminfo_member(s, f.name, f.namelen);
+    if (!member) continue;
+    *member = f.value;
+    if (unlikely(member == &s->MemAvailable)) kernel_mem_available = true;
   }
 
   if (unlikely(!s->MemTotal))
@@ -294,36 +206,147 @@ static bool read_proc_meminfo(struct memstate *s)
 }
 
 
-bool check_memory_status(void)
+/* The configured elasticities are guesses, and on some workloads (databases in
+ * particular) they are badly wrong: the page cache may be the working set, and
+ * reclaiming it just means reading it all back in.  The kernel's workingset
+ * counters in /proc/vmstat tell us how much of what it reclaims is soon faulted
+ * back in.  From that we learn how much of the cache can really be reclaimed,
+ * and move the elasticities towards it, within elasticity_range of the
+ * configured values.
+ */
+
+/// Minimum number of pages scanned between samples to learn anything from them
+#define RECLAIM_MIN_SCAN 256
+
+/// Learned elasticities, in percent; negative while nothing has been learned
+static double cache_learned = -1, buffers_learned = -1;
+
+/// Percentage of scanned pages durably reclaimed, as last seen, or -1
+static int reclaim_pct = -1;
+
+static struct vmstat last_vmstat;
+static bool have_vmstat = false;
+
+static inline int cache_elasticity_now(void)
 {
-  const memsize_t init_req = memory_target();
-  if (unlikely(init_req == MEMSIZE_ERROR)) return false;
-#ifndef NO_CONFIG
-  if (init_req && !quiet)
+  return (cache_learned < 0) ? cache_elasticity : (int)cache_learned;
+}
+
+static inline int buffer_elasticity_now(void)
+{
+  return (buffers_learned < 0) ? buffer_elasticity : (int)buffers_learned;
+}
+
+/// Move learned elasticity a step towards target, within bounds
+static double adapt(double learned, int configured, int target)
+{
+  if (learned < 0) learned = configured;
+  learned += (target - learned) / 4;
+
+  const int lo = configured - elasticity_range,
+	    hi = configured + elasticity_range;
+  if (learned < lo) learned = lo;
+  if (learned > hi) learned = hi;
+  if (learned < 0) learned = 0;
+  if (learned > 100) learned = 100;
+  return learned;
+}
+
+/// Learn elasticities from page reclaim statistics
+/**
+ * @param vs Sample of /proc/vmstat, or NULL if we couldn't read it
+ */
+static void adapt_elasticity(const struct vmstat *vs)
+{
+  if (!elasticity_range) return;
+
+  if (unlikely(!vs))
   {
-    printf("Initial memory status: ");
-    if (init_req > 0)
-      logm(LOG_INFO, "would prefer %lld extra bytes", init_req);
-    else
-      logm(LOG_INFO, "%lld bytes to spare", -init_req);
+    logm(LOG_NOTICE, "Not learning cache elasticity");
+    elasticity_range = 0;
+    return;
   }
-#endif
-  return true;
+  if (!have_vmstat)
+  {
+    last_vmstat = *vs;
+    have_vmstat = true;
+    return;
+  }
+
+  // Until the kernel has done some reclaiming, there's nothing to learn from.
+  const memsize_t scanned = vs->pgscan - last_vmstat.pgscan;
+  if (scanned < RECLAIM_MIN_SCAN) return;
+
+  /* Pages reclaimed and not soon faulted back in were truly free.  Refaults
+   * that went straight back onto the active list were part of the working set,
+   * which means we're close to thrashing; count those double.
+   */
+  const memsize_t durable = (vs->pgsteal - last_vmstat.pgsteal) -
+    (vs->refault - last_vmstat.refault) -
+    (vs->activate - last_vmstat.activate);
+  reclaim_pct = (durable > 0) ? (int)(100*durable/scanned) : 0;
+  if (reclaim_pct > 100) reclaim_pct = 100;
+
+  cache_learned = adapt(cache_learned, cache_elasticity, reclaim_pct);
+  buffers_learned = adapt(buffers_learned, buffer_elasticity, reclaim_pct);
+  last_vmstat = *vs;
 }
 
 
 /// How much buffer space can we expect the system to free up?
 static inline memsize_t buffers_free(const struct memstate *st)
 {
-  return (st->Buffers/100) * buffer_elasticity;
+  return (st->Buffers/100) * buffer_elasticity_now();
 }
 
 
 /// How much cache space can we expect the system to free up?
 static inline memsize_t cache_free(const struct memstate *st)
 {
-  const memsize_t cache = st->Cached - (st->Dirty + st->Writeback + st->Shmem);
-  return (cache > 0) ? (cache/100)*cache_elasticity : 0;
+  /* Unevictable pages (ramfs, mlock()ed files, locked shared memory) may sit
+   * in the cache, but will never be freed.  Locked shared memory is counted in
+   * both Shmem and Unevictable; we'd rather underestimate than overestimate.
+   */
+  const memsize_t cache = st->Cached -
+    (st->Dirty + st->Writeback + st->Shmem + st->Unevictable);
+  return (cache > 0) ? (cache/100)*cache_elasticity_now() : 0;
+}
+
+
+/// How much reclaimable kernel memory (dentries, inodes) can be freed up?
+static inline memsize_t slab_free(const struct memstate *st)
+{
+  return (st->SReclaimable/100)*cache_elasticity_now();
+}
+
+
+/// Memory reserved for huge pages, which nothing else can ever use
+static inline memsize_t hugetlb(const struct memstate *st)
+{
+  if (st->Hugetlb) return st->Hugetlb;
+  return st->HugePages_Total * st->Hugepagesize;
+}
+
+
+/// Memory the kernel holds for itself, which can't be freed
+static inline memsize_t kernel_pinned(const struct memstate *st)
+{
+  return st->SUnreclaim + st->KernelStack + st->PageTables;
+}
+
+
+/// How much memory does the kernel say is available, after what we've learned?
+static inline memsize_t available_free(const struct memstate *st)
+{
+  /* MemAvailable includes the kernel's own estimate of reclaimable cache.  If
+   * reclaim has proven less effective than cache_elasticity assumes, discount
+   * that part accordingly.  We never think more is available than the kernel.
+   */
+  const int learned = cache_elasticity_now();
+  if (learned >= cache_elasticity || st->MemAvailable <= st->MemFree)
+    return st->MemAvailable;
+  return st->MemFree +
+    ((st->MemAvailable - st->MemFree)/cache_elasticity) * learned;
 }
 
 
@@ -355,82 +378,475 @@ static inline memsize_t space_free(const struct memstate *st)
    * considered in-use.
    */
   if (kernel_mem_available) {
-    return st->MemAvailable + st->SwapFree;
+    return available_free(st) + st->SwapFree;
   } else {
     return st->MemFree +
       st->SwapFree +
       st->SwapCached +
       buffers_free(st) +
-      cache_free(st);
+      cache_free(st) +
+      slab_free(st);
   }
 }
 
 static inline memsize_t space_total(const struct memstate *st)
 {
-  return st->MemTotal + st->SwapTotal;
+  /* The huge page pool is part of MemTotal, but it is not available to anything
+   * else, and it's not free as far as MemFree or MemAvailable are concerned.
+   * Counting it makes a box full of hugetlb reservations look roomier than it
+   * is.
+   */
+  return st->MemTotal - hugetlb(st) + st->SwapTotal;
 }
 
+/// Wide type for intermediate results of byte-count arithmetic
+/** Multiplying a byte count by a percentage, in hundredths, can overflow 64
+ * bits on a machine with a few terabytes of memory.
+ */
+#ifdef __SIZEOF_INT128__
+__extension__ typedef __int128 wide_t;
+#else
+typedef long double wide_t;
+#endif
+
 static inline int pct_free(const struct memstate *st)
 {
-  // Phrased oddly to avoid integer overflows
-  return space_free(st)/(space_total(st)/100);
+  return (int)((wide_t)space_free(st)*100 / space_total(st));
+}
+
+/// Size of limit for given total space
+static memsize_t limit_bytes(const struct limit *l, memsize_t total)
+{
+  memsize_t result = LLONG_MAX;
+  if (l->hundredths >= 0)
+    result = (memsize_t)((wide_t)total*l->hundredths / 10000);
+  if (l->bytes >= 0 && l->bytes < result) result = l->bytes;
+  return result;
 }
 
 
-static memsize_t ideal_swapsize(memsize_t totalspace, memsize_t freespace)
+/* A flat lower_freelimit is an arbitrary line.  What really matters is when the
+ * kernel runs out of memory it can reclaim: kswapd wakes up once a zone's free
+ * memory drops below its "low" watermark and reclaims until it's back above
+ * "high," and once it drops below "min," allocations stall.  With the watermark
+ * policy, we allocate swap when free space (including what can be reclaimed)
+ * comes within one high-to-min distance of kswapd's wakeup point.  And we
+ * allocate if any zone has already dropped below its min watermark.
+ *
+ * The distances between the watermarks are what watermark_scale_factor sets,
+ * so the trigger follows it without our having to redo the kernel's sums.
+ */
+
+/// Zone watermarks as of the last full sample
+static struct watermarks wm;
+static bool wm_known = false;
+
+/// Sample zone watermarks if watermark policy is enabled.  Clobbers localbuf.
+static void sample_watermarks(void)
 {
-  /* This is phrased rather oddly, and a fairly high rounding error is
-   * introduced.
-   *
-   * The reason is to avoid overflows in the computation: we effectively compute
-   * at a granularity of 100 bytes to avoid overflows, then multiply by 100
-   * again to get back to an approximation of our original number.
-   *
-   * This might conceivably be a problem if freetarget is ridiculously close to
-   * either freespace threshold.
-   *
-   * We try to find the ideal allocation size x>0 such that if we add x free
-   * bytes (i.e. we add it to both freespace and totalspace), we end up at
-   * exactly our freetarget.  In mathematical terms, i.e. without caring about
-   * rounding or overflows:
-   *
-   * 	(freespace+x)/(totalspace+x) = freetarget/100			<=>
-   * 	freespace+x = freetarget*(totalspace+x)/100			<=>
-   * 	100*(freespace+x)/freetarget = totalspace+x			<=>
-   * 	100*freespace/freetarget+100*x/freetarget = totalspace+x	<=>
-   * 	100*freespace/freetarget-totalspace = x - 100*x/freetarget	<=>
-   * 	x-100*x/freetarget = 100*freespace/freetarget - totalspace	<=>
-   * 	x*(1-100/freetarget) = 100*freespace/freetarget - totalspace	<=>
-   *
-   * 	x = (100*freespace/freetarget - totalspace) / (1 - 100/freetarget)
-   * 	  = (100*freespace - freetarget*totalspace) / (freetarget - 100)
-   *
-   * This latter expression we convert to an overflow-free form by dividing both
-   * freespace and totalspace by some constant p, and multiplying by this same p
-   * afterwards:
+  if (!watermark_policy) return;
+  wm_known = read_watermarks(&wm);
+  if (unlikely(!wm_known))
+  {
+    logm(LOG_NOTICE, "No zone watermarks; using lower_freelimit instead");
+    watermark_policy = false;
+  }
+}
+
+/// Free space below which the watermark policy wants more swap, in bytes
+static memsize_t watermark_trigger(void)
+{
+  /* The zones' min watermarks add up to min_free_kbytes, less what goes to
+   * zones we skipped; the kernel won't let free memory get below either.
+   */
+  const memsize_t reserve = MAX(wm.min, wm.min_free);
+  return wm.low + MAX(wm.high - reserve, 0);
+}
+
+/// Free space below which we want more swap, in bytes
+static memsize_t lower_limit(memsize_t total)
+{
+  if (wm_known) return watermark_trigger();
+  return limit_bytes(&lower_freelimit, total);
+}
+
+/// Free space above which we want less swap, in bytes
+static inline memsize_t upper_limit(memsize_t total)
+{
+  return limit_bytes(&upper_freelimit, total);
+}
+
+/// Are allocations stalling on direct reclaim already?
+static inline bool watermarks_breached(void)
+{
+  return wm_known && wm.zones_min > 0;
+}
+
+
+/// Swap to add (or, if negative, remove) to bring free space up to target
+static memsize_t solve_swapsize(const struct limit *target,
+    memsize_t totalspace,
+    memsize_t freespace)
+{
+  /* We try to find the ideal allocation size x>0 such that if we add x free
+   * bytes of swap space, the proportion of free space will be exactly
+   * target.  With target as a fraction t of total space:
    *
-   *  x/p = (100*freespace/p - freetarget*totalspace/p) / (freetarget-100)
+   * 	(freespace+x)/(totalspace+x) = t			<=>
+   * 	freespace+x = t*totalspace + t*x			<=>
+   * 	x = (t*totalspace - freespace) / (1-t)
    *
-   * The natural choice for p is 100, since it gives up the exact minimum
-   * precision while ensuring that both 100*freespace/p and (given that
-   * freetarget<100) freetarget*totalspace/p remain within the range of
-   * representable numbers, assuming that freespace and totalspace were
-   * themselves representable to begin with.
+   * Expressing t in hundredths of a percent, h = 10000*t:
    *
-   * For p==100 we get:
+   * 	x = (h*totalspace - 10000*freespace) / (10000-h)
    *
-   * x/100 = (100*freespace/100-freetarget*totalspace/100) / (freetarget-100)
-   *       = (freespace - freetarget*totalspace/100) / (freetarget-100)
+   * On a machine with terabytes of memory, the products overflow 64 bits, so
+   * we compute them in wide_t.  The result itself is no larger than about
+   * 100 times totalspace (targets are at most 99%), so it fits.
    *
-   * Note that one of the two divisions by p has disappeared.  To recover as
-   * much of that lost precision of the remaining division-by-p, we round to the
-   * nearest integer, not downwards:
+   * For a target given as a size B, it's simply x = B - freespace.  If
+   * both are given, the target is the lesser of the two.  Since free space
+   * grows faster with x than a percentage of total space does, that makes x the
+   * lesser of the two solutions as well.
    */
-  return 100 * ((freespace-freetarget*((totalspace+50)/100))/(freetarget-100));
+  memsize_t x = LLONG_MAX;
+  const int h = target->hundredths;
+  if (h >= 0)
+    x = (memsize_t)(((wide_t)h*totalspace - (wide_t)10000*freespace) /
+	(10000 - h));
+  if (target->bytes >= 0 && target->bytes - freespace < x)
+    x = target->bytes - freespace;
+  return x;
+}
+
+
+static inline memsize_t ideal_swapsize(memsize_t totalspace,
+    memsize_t freespace)
+{
+  return solve_swapsize(&freetarget, totalspace, freespace);
+}
+
+
+/* Under strict overcommit (vm.overcommit_memory=2), allocations start failing
+ * once Committed_AS reaches CommitLimit, which may well happen while there is
+ * still plenty of free memory.  CommitLimit includes all swap space, so every
+ * byte of swap we add raises it by one byte.  That makes commit headroom, i.e.
+ * CommitLimit - Committed_AS, just another kind of free space for the purposes
+ * of solve_swapsize().
+ */
+static struct procfile proc_overcommit_memory =
+  PROCFILE("/proc/sys/vm/overcommit_memory");
+static struct procfile proc_overcommit_ratio =
+  PROCFILE("/proc/sys/vm/overcommit_ratio");
+static struct procfile proc_overcommit_kbytes =
+  PROCFILE("/proc/sys/vm/overcommit_kbytes");
+
+/// Overcommit settings as of the last full sample; mode -1 if unknown
+static int overcommit_mode = -1, overcommit_ratio = -1;
+static memsize_t overcommit_kbytes = -1;
+
+static inline bool strict_overcommit(void)
+{
+  return overcommit_mode == 2;
+}
+
+/// Read the overcommit sysctls.  Clobbers localbuf.
+static void sample_overcommit(void)
+{
+  overcommit_mode = (int)procfile_number(&proc_overcommit_memory);
+  if (!strict_overcommit()) return;
+  overcommit_ratio = (int)procfile_number(&proc_overcommit_ratio);
+  overcommit_kbytes = procfile_number(&proc_overcommit_kbytes);
+}
+
+/// The kernel's commit limit, computed by hand if /proc/meminfo lacks it
+static memsize_t commit_limit(const struct memstate *st)
+{
+  if (st->CommitLimit > 0) return st->CommitLimit;
+  if (overcommit_kbytes > 0) return overcommit_kbytes*KILO + st->SwapTotal;
+  if (overcommit_ratio < 0) return 0;
+  return (st->MemTotal - hugetlb(st))/100*overcommit_ratio + st->SwapTotal;
 }
 
+/// Swap needed to keep commit headroom at target; negative if we have excess
+static memsize_t commit_swapsize(const struct memstate *st)
+{
+  const memsize_t limit = commit_limit(st);
+  if (limit <= 0) return 0;
+  return solve_swapsize(&commit_headroom, limit, limit - st->Committed_AS);
+}
+
+
+/* Shared memory--tmpfs, SysV shm, shared anonymous mappings--can only ever be
+ * reclaimed by swapping it out.  A build that fills /tmp with tens of gigabytes
+ * pins all of that in RAM unless there is enough free swap to push it to.  So
+ * if tmpfs_swap is set, we keep enough free swap to evict that share of it.
+ */
+
+/// Bytes in tmpfs filesystems as of the last full sample, or -1 if unknown
+static memsize_t tmpfs_used = -1;
 
-memsize_t memory_target(void)
+/// Shared memory in RAM
+static memsize_t shmem_resident(const struct memstate *st)
+{
+  /* Shmem counts only what is resident; tmpfs usage includes what has been
+   * swapped out already.  The latter is only a fallback, for kernels older
+   * than 2.6.32.
+   */
+  if (st->Shmem > 0 || tmpfs_used < 0) return st->Shmem;
+  return tmpfs_used;
+}
+
+/// Swap needed to evict tmpfs_swap% of shared memory; negative if in excess
+static inline memsize_t shmem_swapsize(const struct memstate *st)
+{
+  return shmem_resident(st)/100*tmpfs_swap - st->SwapFree;
+}
+
+
+/// Take a full sample at least this often (in seconds), fast path or no
+#define FULL_SAMPLE_INTERVAL 30
+
+/// runclock at last full sample, or -1 if the fast path is not calibrated
+static time_t last_full_sample = -1;
+
+/// How far the last full estimate of free space exceeded the quick one
+/** The quick estimate can't see the page cache, which is often where most of
+ * the "free" memory is.  We assume that hasn't changed much since our last full
+ * sample.  A sudden change in cache size is the main reason why this can go
+ * wrong; hence the margin, and regular full samples.
+ */
+static memsize_t quick_correction = 0;
+
+/// Huge page pool as of the last full sample; sysinfo() counts it as memory
+static memsize_t quick_hugetlb = 0;
+
+/// Quick estimate of shmem_swapsize()
+static memsize_t quick_shmem_need = 0;
+
+/// Physical memory size according to sysinfo(), as of the last quick sample
+static memsize_t quick_memtotal = 0;
+
+/// Swap space wanted by cgroups and NUMA nodes, as of the last scan
+static memsize_t last_cgroup_demand = 0, last_numa_demand = 0;
+
+/// Physical memory size that our thresholds were last adjusted to, if known
+static memsize_t memtotal_baseline = -1;
+
+/// Change in memory size, as a fraction of memory, that we react to
+/** A balloon driver may trim or add a few pages at a time.  We let that add up
+ * until the difference is worth recomputing everything for.
+ */
+#define RESIZE_FRACTION 32
+
+/// Compare memory size to baseline
+/**
+ * @return Change in memory size since the baseline was set, if large enough to
+ * act on; zero otherwise
+ */
+static memsize_t note_memtotal(memsize_t memtotal)
+{
+  if (unlikely(memtotal_baseline < 0)) memtotal_baseline = memtotal;
+  const memsize_t delta = memtotal - memtotal_baseline;
+  if (likely(llabs(delta) < memtotal_baseline/RESIZE_FRACTION)) return 0;
+
+  memtotal_baseline = memtotal;
+  // The fast path's calibration is off now.  Take a full sample next time.
+  last_full_sample = -1;
+  return delta;
+}
+
+/// Free space in excess of lower limit at last sample, in tenths of percent
+static int headroom = 0;
+
+int memory_headroom(void)
+{
+  return headroom;
+}
+
+static void note_headroom(memsize_t totalspace, memsize_t freespace)
+{
+  headroom = (freespace - lower_limit(totalspace))/(totalspace/1000);
+}
+
+
+/// Estimate total and free space using just the sysinfo() system call
+static bool quick_sample(memsize_t *total, memsize_t *freespace)
+{
+  struct sysinfo si;
+  if (unlikely(sysinfo(&si) == -1)) return false;
+
+  const memsize_t unit = si.mem_unit;
+  *total = ((memsize_t)si.totalram + si.totalswap) * unit - quick_hugetlb;
+  quick_memtotal = (memsize_t)si.totalram * unit;
+  *freespace = ((memsize_t)si.freeram + si.freeswap) * unit +
+    ((memsize_t)si.bufferram * unit / 100) * buffer_elasticity_now();
+  quick_shmem_need =
+    ((memsize_t)si.sharedram * unit / 100) * tmpfs_swap - si.freeswap * unit;
+  return *total > 0;
+}
+
+
+/// Are we clearly within the comfort zone between both freelimits?
+static bool comfortably_steady(memsize_t quicktotal, memsize_t quickfree)
+{
+  if (last_full_sample < 0 ||
+      runclock - last_full_sample >= FULL_SAMPLE_INTERVAL)
+    return false;
+  // sysinfo() can't tell us anything about commit headroom
+  if (strict_overcommit()) return false;
+  if (quick_shmem_need > 0) return false;
+
+  const memsize_t freespace = quickfree + quick_correction;
+  note_headroom(quicktotal, freespace);
+  const memsize_t margin = (quicktotal/100)*fastpath_margin;
+  return freespace >= lower_limit(quicktotal) + margin &&
+    freespace <= upper_limit(quicktotal) - margin;
+}
+
+
+bool sample_memory(struct snapshot *snap, bool thorough)
+{
+  struct memstate *const st = &snap->mem;
+  memset(st, 0, sizeof(*st));
+  snap->meminfo = false;
+  if (snap->scan)
+  {
+    last_cgroup_demand = cgroup_demand();
+    last_numa_demand = numa_demand();
+  }
+  snap->cgroup_demand = last_cgroup_demand;
+  snap->numa_demand = last_numa_demand;
+
+  /* Most of the time we're nowhere near either freelimit, and all it takes to
+   * see that is one cheap system call.  Only when we get close do we need to
+   * parse /proc/meminfo for the fine details.
+   */
+  memsize_t quicktotal, quickfree;
+  const bool quick = fastpath_margin && quick_sample(&quicktotal, &quickfree);
+  if (quick) snap->resized = note_memtotal(quick_memtotal);
+  if (quick &&
+      !thorough &&
+      !snap->resized &&
+      !snap->cgroup_demand &&
+      !snap->numa_demand &&
+      comfortably_steady(quicktotal, quickfree))
+  {
+    snap->space_total = quicktotal;
+    snap->space_free = quickfree + quick_correction;
+    thrash_sample(&snap->taken, NULL, &snap->rates);
+    return true;
+  }
+
+  if (unlikely(!read_proc_meminfo(st))) return false;
+  if (!quick) snap->resized = note_memtotal(st->MemTotal);
+
+  // Learning elasticities and watching for thrashing share one vmstat sample.
+  struct vmstat vs;
+  const bool vmstat_read =
+    (elasticity_range || thrash_watched()) && read_vmstat(&vs);
+  adapt_elasticity(vmstat_read ? &vs : NULL);
+  thrash_sample(&snap->taken, vmstat_read ? &vs : NULL, &snap->rates);
+  if (snap->scan) sample_watermarks();
+  sample_overcommit();
+  if (tmpfs_swap && snap->scan) tmpfs_used = tmpfs_usage();
+  snap->meminfo = true;
+  snap->space_total = space_total(st);
+  snap->space_free = space_free(st);
+
+  if (quick)
+  {
+    quick_correction = snap->space_free - quickfree;
+    quick_hugetlb = hugetlb(st);
+    last_full_sample = runclock;
+  }
+  note_headroom(snap->space_total, snap->space_free);
+  return true;
+}
+
+
+/// Desired swapfile size if we're exactly at the lower limit
+static memsize_t swapfile_at_limit(memsize_t total)
+{
+  return ideal_swapsize(total, lower_limit(total));
+}
+
+
+/// Allocate ahead of time by this factor of expected swapfile creation time
+/** The forecast is only a straight line, and we won't look again until the
+ * next tick, so leave some margin.
+ */
+#define LEAD_FACTOR 2
+
+/// Seconds until free space is forecast to drop below the lower limit
+/** Returns a negative number if it's not going to happen, as far as we know.
+ */
+static double secs_to_limit(const struct snapshot *snap)
+{
+  const struct forecast *const fc = &snap->trend;
+  if (!trend_reliable(fc) || fc->growth <= 0) return -1;
+  const memsize_t limit = lower_limit(snap->space_total);
+  if (snap->space_free <= limit) return 0;
+  return (snap->space_free - limit) / fc->growth;
+}
+
+
+/// Swap space to allocate ahead of crossing the lower limit, if any
+static memsize_t anticipate(const struct snapshot *snap)
+{
+  const double secs_left = secs_to_limit(snap);
+  if (secs_left <= 0) return 0;
+
+  // How long would it take to create the swapfile we'd want at the limit?
+  const memsize_t total = snap->space_total;
+  const memsize_t limit = lower_limit(total);
+  const double lead =
+    LEAD_FACTOR * swapfile_creation_time(swapfile_at_limit(total));
+  if (secs_left > lead) return 0;
+
+  // Cover the shortfall we project for when the new swapfile will be ready.
+  memsize_t projected = snap->space_free - (memsize_t)(snap->trend.growth*lead);
+  if (projected > limit) projected = limit;
+#ifndef NO_CONFIG
+  if (verbose)
+    logm(LOG_DEBUG,
+	"Forecast: lower limit in %.1f s; swapfile takes %.1f s",
+	secs_left,
+	lead/LEAD_FACTOR);
+#endif
+  return ideal_swapsize(total, projected);
+}
+
+
+/// Percentage of total space that freetarget comes to
+static double target_pct(memsize_t total)
+{
+  return (double)limit_bytes(&freetarget, total) * 100 / total;
+}
+
+
+void memory_control(struct snapshot *snap)
+{
+  if (!policy_controlled()) return;
+  const memsize_t total = snap->space_total;
+  if (unlikely(total <= 0)) return;
+
+  /* Adding x bytes of swap moves free space by about (1-t)*x/total, where t is
+   * the target fraction of free space.  That's how far the smallest swapfile
+   * we're willing to create would move it.
+   */
+  const double setpoint = target_pct(total);
+  const double deadband =
+    (double)swapfile_quantum() * (100 - setpoint) / total;
+  pid_sample(&snap->taken,
+      setpoint,
+      (double)snap->space_free * 100 / total,
+      deadband,
+      &snap->control);
+}
+
+
+memsize_t memory_target(const struct snapshot *snap)
 {
   /* Determining how much memory we need is a pretty difficult job.  One reason
    * is that if no swap space is available under Linux 2.6, lots of pages stay
@@ -439,31 +855,233 @@ memsize_t memory_target(void)
    * made available for other uses!
    */
 
-  assert(upper_freelimit > lower_freelimit);
+  const memsize_t total = snap->space_total, freespace = snap->space_free;
+  struct policy_input in;
+  in.snap = snap;
+  in.total = total;
+  in.freespace = freespace;
+  in.lower = lower_limit(total);
+  in.upper = upper_limit(total);
+  in.breached = snap->meminfo && watermarks_breached();
+  in.ideal = ideal_swapsize(total, freespace);
+  /* If the limits mix percentages and sizes, freetarget may lie outside the
+   * freelimits on this machine: say, 16g on a machine where 20% is more.  That
+   * can't be checked until we know the total.  Below the lower limit, don't
+   * aim for less than the lower limit, and above the upper limit, for no more.
+   */
+  if (freespace < in.lower && in.ideal < in.lower - freespace)
+    in.ideal = in.lower - freespace;
+  if (freespace > in.upper && in.ideal > in.upper - freespace)
+    in.ideal = in.upper - freespace;
+  in.anticipated = anticipate(snap);
+  in.setpoint = target_pct(total);
+  memsize_t request = policy_target(&in);
+
+  // If we didn't need a full sample, we're comfortably within both limits.
+  if (!snap->meminfo) return request;
+  const struct memstate *const st = &snap->mem;
+
+  /* Under strict overcommit, also keep commit headroom at its target.  That
+   * may mean allocating while memory is plentiful, and it limits how much swap
+   * we can free when memory is overabundant.
+   */
+  if (strict_overcommit())
+  {
+    const memsize_t commit_request = commit_swapsize(st);
+    if (commit_request > request) request = commit_request;
+  }
 
-  struct memstate st = { 0, 0, 0, 0, 0, 0, 0, 0 };
-  if (unlikely(!read_proc_meminfo(&st))) return MEMSIZE_ERROR;
+  // Likewise, keep enough swap to evict shared memory if so configured.
+  if (tmpfs_swap)
+  {
+    const memsize_t shmem_request = shmem_swapsize(st);
+    if (shmem_request > request) request = shmem_request;
+  }
 
-  const int freepct = pct_free(&st);
-  memsize_t request = 0;
+  // And cgroups under pressure need free swap to push their memory out to.
+  if (snap->cgroup_demand)
+  {
+    const memsize_t cgroup_request = snap->cgroup_demand - st->SwapFree;
+    if (cgroup_request > request) request = cgroup_request;
+  }
 
-  // Policy: once we hit either freelimit, steer for "freetarget"% free space
-  // TODO: Use /proc/sys/vm/min_free_kbytes when no swap yet allocated?
-  if (freepct < lower_freelimit || freepct > upper_freelimit)
-    request = ideal_swapsize(space_total(&st), space_free(&st));
+  // The same goes for NUMA nodes under pressure.
+  if (snap->numa_demand)
+  {
+    const memsize_t numa_request = snap->numa_demand - st->SwapFree;
+    if (numa_request > request) request = numa_request;
+  }
 
   return request;
 }
 
 
-memsize_t minimal_swapfile(void)
+bool memory_growth_futile(const struct snapshot *snap)
+{
+  return snap->rates.thrashing &&
+    snap->meminfo &&
+    snap->mem.SwapFree > snap->mem.SwapTotal/2;
+}
+
+
+bool memory_critical(const struct snapshot *snap)
+{
+  if (snap->meminfo && watermarks_breached()) return true;
+  return snap->space_free < lower_limit(snap->space_total)/2;
+}
+
+
+/* A single sample of memory_target() is easily thrown off: a burst of page
+ * cache can make us look overfed for one tick, and a brief dip can make us
+ * allocate a swapfile that will be retired again a few minutes later.  Creating
+ * and deleting swapfiles costs real disk I/O, so we look at a sliding window of
+ * recent targets.  Swap is allocated only if it was needed throughout
+ * alloc_window, and freed only if it was in excess throughout free_window.
+ *
+ * Sliding minimum and maximum are maintained in O(1) amortized time per sample
+ * using monotonic deques: a sample can never again be the window's minimum once
+ * a smaller or equal one has come after it, so it is dropped right away.
+ */
+
+/// Capacity of each deque
+/** If the window holds more samples than this, the oldest ones are dropped
+ * early, effectively shortening the window.  At the default pace, 64 samples
+ * cover over a minute.
+ */
+#define WINDOW_SLOTS 64
+
+struct window_entry
+{
+  long long msecs;
+  memsize_t value;
+};
+
+/// Monotonic deque of window entries, in a ring buffer
+struct deque
+{
+  struct window_entry e[WINDOW_SLOTS];
+  int head, count;
+};
+
+static struct deque target_mins, target_maxs;
+static bool target_averaged = false;
+static double target_average = 0;
+static long long target_msecs = 0;
+
+/// When we started collecting the current history, or LLONG_MIN for startup
+/** Until a full window's worth of history has been collected, we can't tell
+ * whether a shortage or excess is sustained.  At startup, we act right away.
+ */
+static long long target_since = LLONG_MIN;
+static bool target_forgotten = false;
+
+static inline struct window_entry *deque_at(struct deque *d, int i)
+{
+  return &d->e[(d->head + i) % WINDOW_SLOTS];
+}
+
+/// Add sample to deque; sign 1 keeps minimum at front, -1 keeps maximum
+static void deque_push(struct deque *d,
+    int sign,
+    long long msecs,
+    memsize_t value,
+    int window)
+{
+  while (d->count && sign*deque_at(d, d->count-1)->value >= sign*value)
+    --d->count;
+  if (unlikely(d->count == WINDOW_SLOTS))
+  {
+    d->head = (d->head + 1) % WINDOW_SLOTS;
+    --d->count;
+  }
+  struct window_entry *const e = deque_at(d, d->count++);
+  e->msecs = msecs;
+  e->value = value;
+
+  // Expire old samples.  The newest sample always stays.
+  while (d->count > 1 && deque_at(d, 0)->msecs < msecs - window)
+  {
+    d->head = (d->head + 1) % WINDOW_SLOTS;
+    --d->count;
+  }
+}
+
+
+void memory_targets(const struct snapshot *snap, struct target_stats *ts)
+{
+  const long long msecs = snap->taken.tv_sec*1000LL +
+    snap->taken.tv_nsec/1000000;
+  ts->now = snap->target;
+
+  deque_push(&target_mins, 1, msecs, ts->now, alloc_window);
+  deque_push(&target_maxs, -1, msecs, ts->now, free_window);
+  ts->least = deque_at(&target_mins, 0)->value;
+  ts->most = deque_at(&target_maxs, 0)->value;
+
+  if (target_forgotten)
+  {
+    target_since = msecs;
+    target_forgotten = false;
+  }
+  if (target_since != LLONG_MIN)
+  {
+    if (msecs - target_since < alloc_window && ts->least > 0) ts->least = 0;
+    if (msecs - target_since < free_window && ts->most < 0) ts->most = 0;
+  }
+
+  // Exponentially weighted moving average, decaying over free_window
+  if (!target_averaged)
+  {
+    target_average = ts->now;
+    target_averaged = true;
+  }
+  else if (msecs > target_msecs)
+  {
+    const double dt = msecs - target_msecs;
+    target_average += (ts->now - target_average) * dt / (dt + free_window);
+  }
+  target_msecs = msecs;
+  ts->average = (memsize_t)target_average;
+}
+
+
+void memory_forget(void)
+{
+  target_mins.count = target_maxs.count = 0;
+  target_averaged = false;
+  target_forgotten = true;
+}
+
+
+/// Log recommended change in swap size
+static void log_target(memsize_t req)
 {
-  struct memstate st = { 0, 0, 0, 0, 0, 0, 0, 0 };
-  if (unlikely(!read_proc_meminfo(&st))) return MEMSIZE_ERROR;
+  if (req > 0)
+    logm(LOG_INFO, "would prefer %lld extra bytes", req);
+  else
+    logm(LOG_INFO, "%lld bytes to spare", -req);
+}
+
+
+bool check_memory_status(void)
+{
+  struct snapshot snap;
+  if (unlikely(!take_snapshot(&snap, true))) return false;
+#ifndef NO_CONFIG
+  const memsize_t init_req = snap.target;
+  if (init_req && !quiet)
+  {
+    printf("Initial memory status: ");
+    log_target(init_req);
+  }
+#endif
+  return true;
+}
+
 
-  const memsize_t total = space_total(&st);
-  // Compute desired swapfile size if we're exactly at lower_freelimit
-  return ideal_swapsize(total, (total/100)*lower_freelimit);
+memsize_t minimal_swapfile(const struct memstate *st)
+{
+  return swapfile_at_limit(space_total(st));
 }
 
 
@@ -481,11 +1099,36 @@ static void dump_memline(const char category[],
       cached);
 }
 
-void dump_memory(void)
+void dump_memory(const struct snapshot *snap)
 {
-  struct memstate st = { 0, 0, 0, 0, 0, 0, 0, 0 };
-  if (unlikely(!read_proc_meminfo(&st))) return;
-  check_memory_status();
+  dump_trend(&snap->trend);
+  const double secs_left = secs_to_limit(snap);
+  if (secs_left >= 0)
+    logm(LOG_INFO,
+	"forecast: lower limit in %.0f s; swapfile takes %.1f s to create",
+	secs_left,
+	swapfile_creation_time(swapfile_at_limit(snap->space_total)));
+
+  dump_policy();
+  if (policy_controlled()) dump_pid(&snap->control);
+
+  if (target_averaged)
+    logm(LOG_INFO,
+	"recent targets: %lld least, %lld most, %lld average",
+	deque_at(&target_mins, 0)->value,
+	deque_at(&target_maxs, 0)->value,
+	(long long)target_average);
+
+  if (snap->target) log_target(snap->target);
+  if (!snap->meminfo)
+  {
+    logm(LOG_INFO,
+	"quick sample: %lld total, %lld free",
+	snap->space_total,
+	snap->space_free);
+    return;
+  }
+  const struct memstate st = snap->mem;
 
   dump_memline("core", st.MemTotal, st.MemFree, st.Cached);
   dump_memline("swap", st.SwapTotal, st.SwapFree, st.SwapCached);
@@ -500,16 +1143,89 @@ void dump_memory(void)
       st.Dirty,
       st.Writeback);
 
+  logm(LOG_INFO,
+      "pinned: %lld hugetlb, %lld unevictable (%lld mlocked), %lld kernel "
+      "(%lld slab, %lld stacks, %lld page tables)",
+      hugetlb(&st),
+      st.Unevictable,
+      st.Mlocked,
+      kernel_pinned(&st),
+      st.SUnreclaim,
+      st.KernelStack,
+      st.PageTables);
+
+  logm(LOG_INFO,
+      "elasticity: %d%% cache (configured %d%%), %d%% bufs (configured %d%%)",
+      cache_elasticity_now(),
+      cache_elasticity,
+      buffer_elasticity_now(),
+      buffer_elasticity);
+  if (reclaim_pct >= 0)
+    logm(LOG_INFO, "reclaim: %d%% of scanned pages durably freed", reclaim_pct);
+
   const int pf = pct_free(&st);
   logm(LOG_INFO,
-      "estimate free: %lld cache, %lld bufs, %lld total (%d%%)",
+      "estimate free: %lld cache, %lld bufs, %lld slab, %lld total (%d%%)",
       cache_free(&st),
       buffers_free(&st),
+      slab_free(&st),
       space_free(&st),
       pf);
   logm(LOG_INFO,
-      "thresholds: %d%% < %d%% < %d%%",
-      lower_freelimit,
-      pf,
-      upper_freelimit);
+      "limits: %lld lower, %lld upper; %lld bytes free",
+      lower_limit(space_total(&st)),
+      upper_limit(space_total(&st)),
+      space_free(&st));
+
+  if (overcommit_mode >= 0)
+  {
+    const memsize_t limit = commit_limit(&st);
+    logm(LOG_INFO,
+	"commit: %lld committed, %lld limit, %lld headroom; "
+	"overcommit_memory %d",
+	st.Committed_AS,
+	limit,
+	limit - st.Committed_AS,
+	overcommit_mode);
+    if (strict_overcommit())
+      logm(LOG_INFO,
+	  "commit target: %lld headroom (%lld bytes of swap); "
+	  "overcommit_ratio %d, overcommit_kbytes %lld",
+	  limit - st.Committed_AS + commit_swapsize(&st),
+	  commit_swapsize(&st),
+	  overcommit_ratio,
+	  overcommit_kbytes);
+  }
+
+  if (tmpfs_used >= 0)
+  {
+    logm(LOG_INFO,
+	"shmem: %lld in memory, %lld in tmpfs; %lld swap needed to evict %d%%",
+	st.Shmem,
+	tmpfs_used,
+	shmem_swapsize(&st) + st.SwapFree,
+	tmpfs_swap);
+    dump_tmpfs();
+  }
+  dump_cgroups();
+  dump_numa();
+  if (thrash_watched()) dump_thrash(&snap->rates);
+  dump_leak();
+
+  if (wm_known)
+  {
+    logm(LOG_INFO,
+	"watermarks: %lld min, %lld low, %lld high; %lld free in zones",
+	wm.min,
+	wm.low,
+	wm.high,
+	wm.free);
+    logm(LOG_INFO,
+	"zones below watermark: %d low, %d min; "
+	"scale factor %d, min_free_kbytes %lld",
+	wm.zones_low,
+	wm.zones_min,
+	wm.scale_factor,
+	wm.min_free/KILO);
+  }
 }
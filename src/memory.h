@@ -37,15 +37,127 @@ typedef long long memsize_t;
 /// Singular value for memsize_t, analogous to the null pointer
 #define MEMSIZE_ERROR LLONG_MIN
 
+struct snapshot;
+
+/// A free-space threshold: a percentage of total space, a size, or the lesser
+struct limit
+{
+  /// Percentage of total space, in hundredths of a percent; -1 for none
+  int hundredths;
+  /// Size in bytes; -1 for none
+  memsize_t bytes;
+};
+
+/// Memory statistics, as found in /proc/meminfo
+struct memstate
+{
+  memsize_t MemTotal,
+	    MemFree,
+	    MemAvailable,
+	    Buffers,
+	    Cached,
+	    Dirty,
+	    Writeback,
+	    SwapCached,
+	    SwapTotal,
+	    SwapFree,
+	    Shmem,
+	    // Memory that can never be reclaimed
+	    HugePages_Total,	// A count, not a size!
+	    Hugepagesize,
+	    Hugetlb,		// Linux 4.16 and up; all huge page sizes
+	    Unevictable,
+	    Mlocked,
+	    SUnreclaim,
+	    KernelStack,
+	    PageTables,
+	    // Memory that can be reclaimed, besides buffers and cache
+	    SReclaimable,
+	    // Address space the kernel has promised, and how much it may promise
+	    Committed_AS,
+	    CommitLimit;
+};
+
 /// Check if we can access memory status etc.  Clobbers localbuf.
 bool check_memory_status(void);
 
-/// Recommend change in available swap space.  Clobbers localbuf.
+/// Sample memory statistics into snapshot.  Clobbers localbuf.
+/** Unless thorough is set, this first takes a quick look.  If that shows we're
+ * comfortably within both freelimits, /proc/meminfo is not read and the
+ * snapshot's mem is left zeroed.  A change in physical memory size always
+ * makes for a full sample.  Cgroups, NUMA nodes, zone watermarks and tmpfs
+ * usage are only looked at if the snapshot's scan is set.  Sets the snapshot's
+ * meminfo, mem, space_total, space_free, cgroup_demand, numa_demand, resized,
+ * and rates.
+ *
+ * @param snap Snapshot to fill in
+ * @param thorough Always read /proc/meminfo, rather than trusting a quick
+ * estimate that we're nowhere near either freelimit
+ * @return Success
+ */
+bool sample_memory(struct snapshot *snap, bool thorough);
+
+/// Feed snapshot to the PID controller, if the sizing policy uses it
+/** Call once per snapshot, after sample_memory().  Sets the snapshot's control.
+ */
+void memory_control(struct snapshot *snap);
+
+/// Recommend change in available swap space
 /** This is where policy on the total available memory size is formulated.
+ * Besides reacting to either freelimit being crossed, this anticipates crossing
+ * of lower_freelimit if the snapshot's forecast says we'll get there before a
+ * new swapfile could be ready.  How much to allocate or free is up to the
+ * configured sizing policy; on top of that come the needs of strict overcommit,
+ * tmpfs, memory cgroups and NUMA nodes, as configured.  take_snapshot() calls
+ * this and keeps the result as the snapshot's target.
  * @return recommended increase in swap size (negative for a recommended
  * decrease)
  */
-memsize_t memory_target(void);
+memsize_t memory_target(const struct snapshot *snap);
+
+/// Is free memory so low that waiting for the allocation window is too risky?
+/** That is the case when free space is below half of lower_freelimit, or when
+ * the zone watermarks show allocations already stalling on direct reclaim.
+ */
+bool memory_critical(const struct snapshot *snap);
+
+/// Would more swap space go to waste?
+/** That is the case when the system is thrashing with more than half of its
+ * swap space still free: what's short is memory, not swap.
+ */
+bool memory_growth_futile(const struct snapshot *snap);
+
+/// Recent history of memory_target(), so one-tick spikes don't drive policy
+struct target_stats
+{
+  /// Current target
+  memsize_t now;
+  /// Smallest target during the last alloc_window milliseconds
+  memsize_t least;
+  /// Largest target during the last free_window milliseconds
+  memsize_t most;
+  /// Exponentially weighted moving average of targets
+  memsize_t average;
+};
+
+/// Add a snapshot's target to the history of recent targets
+/**
+ * @param snap Snapshot whose target to add; must be newer than any before
+ * @param ts Receives current target and statistics over recent ones
+ */
+void memory_targets(const struct snapshot *snap, struct target_stats *ts);
+
+/// Forget history of recent targets
+/** Call this whenever swap space is added or removed: targets from before are
+ * no longer meaningful.
+ */
+void memory_forget(void);
+
+/// Free space in excess of lower_freelimit, as of the last sample_memory()
+/** Expressed in tenths of a percent of total space; negative if we're below
+ * the lower limit.
+ */
+int memory_headroom(void);
 
 /// What is the minimum swapfile size we can expect to allocate?
 /** This has nothing to do with the minimal permissible swapfile size; it
@@ -57,17 +169,24 @@ memsize_t memory_target(void);
  * partition, and to warn if there is not enough space free on that partition
  * for swapspace to do useful work.
  */
-memsize_t minimal_swapfile(void);
+memsize_t minimal_swapfile(const struct memstate *st);
 
 /// Log memory statistics
-void dump_memory(void);
+void dump_memory(const struct snapshot *snap);
 
 #ifndef NO_CONFIG
-char *set_lower_freelimit(long long pct);
-char *set_upper_freelimit(long long pct);
-char *set_freetarget(long long pct);
+char *set_lower_freelimit(long long dummy);
+char *set_upper_freelimit(long long dummy);
+char *set_freetarget(long long dummy);
+char *set_commit_headroom(long long dummy);
 char *set_buffer_elasticity(long long pct);
+char *set_tmpfs_swap(long long pct);
 char *set_cache_elasticity(long long pct);
+char *set_elasticity_range(long long pct);
+char *set_fastpath_margin(long long pct);
+char *set_watermarks(long long dummy);
+char *set_alloc_window(long long msecs);
+char *set_free_window(long long msecs);
 
 bool memory_check_config(void);
 #endif
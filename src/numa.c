@@ -0,0 +1,291 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "log.h"
+#include "numa.h"
+#include "procfile.h"
+#include "support.h"
+
+
+/// Configuration item: node is under pressure below n% free; 0 disables
+static int numa_pressure = 0;
+
+#ifndef NO_CONFIG
+char *set_numa_pressure(long long pct)
+{
+  numa_pressure = (int)pct;
+  return NULL;
+}
+#endif
+
+
+/// Most memory nodes we keep track of
+#define MAX_NODES 64
+
+struct node
+{
+  int id;
+  char meminfo_path[64], numastat_path[64];
+  struct procfile meminfo, numastat;
+
+  // As of the last sample
+  memsize_t total, free, active_file, inactive_file;
+  /// Allocations that wanted another node, but got this one
+  long long miss;
+  /// Allocations that wanted this node, but got another
+  long long foreign;
+  /// Increase in foreign since the sample before
+  long long foreign_delta;
+  bool pressured;
+};
+
+static struct node nodes[MAX_NODES];
+/// Number of nodes, or -1 if we haven't looked yet
+static int num_nodes = -1;
+
+/// NUMA node of swap directory's device; -1 if unknown, -2 if not looked up
+static int swapdir_node = -2;
+
+static struct procfile sys_nodes_online =
+  PROCFILE("/sys/devices/system/node/online");
+
+
+static void add_node(int id)
+{
+  if (unlikely(num_nodes == MAX_NODES)) return;
+  struct node *const n = &nodes[num_nodes++];
+  memset(n, 0, sizeof(*n));
+  n->id = id;
+  snprintf(n->meminfo_path,
+      sizeof(n->meminfo_path),
+      "/sys/devices/system/node/node%d/meminfo",
+      id);
+  snprintf(n->numastat_path,
+      sizeof(n->numastat_path),
+      "/sys/devices/system/node/node%d/numastat",
+      id);
+  n->meminfo.path = n->meminfo_path;
+  n->meminfo.fd = -1;
+  n->numastat.path = n->numastat_path;
+  n->numastat.fd = -1;
+}
+
+
+static int parse_int(const char **pos)
+{
+  int v = 0;
+  const char *p;
+  for (p = *pos; *p >= '0' && *p <= '9'; ++p) v = v*10 + (*p - '0');
+  *pos = p;
+  return v;
+}
+
+
+/// Find online nodes; a list of ranges, such as "0-1,3".  Clobbers localbuf.
+static void discover_nodes(void)
+{
+  num_nodes = 0;
+  if (procfile_read(&sys_nodes_online) <= 0) return;
+
+  const char *p = localbuf;
+  while (*p >= '0' && *p <= '9')
+  {
+    const int first = parse_int(&p);
+    int last = first;
+    if (*p == '-')
+    {
+      ++p;
+      last = parse_int(&p);
+    }
+    for (int id = first; id <= last; ++id) add_node(id);
+    if (*p != ',') break;
+    ++p;
+  }
+}
+
+
+/// Parse a line of a node's meminfo, e.g. "Node 0 MemFree:  3220448 kB"
+static void node_meminfo_line(const char line[], size_t len, void *arg)
+{
+  struct node *const n = arg;
+  const char *p = line;
+  if (strncmp(p, "Node ", 5) != 0) return;
+  for (p += 5; *p == ' ' || (*p >= '0' && *p <= '9'); ++p);
+
+  struct procfield f;
+  if (!procfile_field(&p, &f)) return;
+  if (field_is(&f, "MemTotal")) n->total = f.value;
+  else if (field_is(&f, "MemFree")) n->free = f.value;
+  else if (field_is(&f, "Active(file)")) n->active_file = f.value;
+  else if (field_is(&f, "Inactive(file)")) n->inactive_file = f.value;
+}
+
+
+/// Sample a node's meminfo and numastat.  Clobbers localbuf.
+static bool sample_node(struct node *n)
+{
+  n->total = n->free = n->active_file = n->inactive_file = 0;
+  if (unlikely(!procfile_lines(&n->meminfo, node_meminfo_line, n)))
+    return false;
+
+  const long long old_foreign = n->foreign;
+  if (procfile_read(&n->numastat) > 0)
+  {
+    struct procfield f;
+    const char *pos = localbuf;
+    while (procfile_field(&pos, &f))
+    {
+      if (field_is(&f, "numa_miss")) n->miss = f.value;
+      else if (field_is(&f, "numa_foreign")) n->foreign = f.value;
+    }
+  }
+  n->foreign_delta = old_foreign ? n->foreign - old_foreign : 0;
+  return n->total > 0;
+}
+
+
+/// Free memory on node, counting inactive page cache
+static inline memsize_t node_free(const struct node *n)
+{
+  return n->free + n->inactive_file;
+}
+
+
+/// Node has just come under pressure
+static void note_pressure(const struct node *n)
+{
+  if (swapdir_node == -2) swapdir_node = numa_path_node(".");
+
+  /* We have only the one swap directory, so there is no choice of where to
+   * put a new swapfile.  The kernel (since 4.14) does prefer swap devices on a
+   * node's own storage when swapping from it, as long as they were enabled
+   * without an explicit priority, as ours are.
+   */
+  if (swapdir_node >= 0 && swapdir_node != n->id)
+    logm(LOG_NOTICE,
+	"Memory node %d is under pressure, but swap directory is on node %d",
+	n->id,
+	swapdir_node);
+#ifndef NO_CONFIG
+  else if (verbose)
+    logm(LOG_DEBUG, "Memory node %d is under pressure", n->id);
+#endif
+}
+
+
+memsize_t numa_demand(void)
+{
+  if (!numa_pressure) return 0;
+  if (num_nodes < 0) discover_nodes();
+  if (num_nodes < 2) return 0;
+
+  memsize_t demand = 0;
+  for (int i = 0; i < num_nodes; ++i)
+  {
+    struct node *const n = &nodes[i];
+    const bool was_pressured = n->pressured;
+    n->pressured = false;
+    if (unlikely(!sample_node(n))) continue;
+
+    const memsize_t threshold = n->total/100*numa_pressure;
+    if (node_free(n) >= threshold) continue;
+    n->pressured = true;
+    demand += threshold - node_free(n);
+    if (!was_pressured) note_pressure(n);
+  }
+  return demand;
+}
+
+
+int numa_path_node(const char path[])
+{
+  struct stat st;
+  if (stat(path, &st) == -1) return -1;
+
+  char link[64], dir[PATH_MAX];
+  snprintf(link,
+      sizeof(link),
+      "/sys/dev/block/%u:%u",
+      major(st.st_dev),
+      minor(st.st_dev));
+  if (!realpath(link, dir)) return -1;
+
+  /* Walk up the device tree until we find a numa_node attribute.  A partition
+   * or virtio disk is on the node of the controller it hangs off.
+   */
+  static const char attr[] = "/numa_node";
+  for (size_t len = strlen(dir);
+      len > sizeof("/sys/devices") && len + sizeof(attr) <= sizeof(dir);
+      dir[len] = '\0')
+  {
+    strcpy(dir+len, attr);
+    const int fd = open(dir, O_RDONLY|O_CLOEXEC);
+    if (fd != -1)
+    {
+      char buf[16];
+      const ssize_t n = read(fd, buf, sizeof(buf)-1);
+      close(fd);
+      if (n <= 0) return -1;
+      buf[n] = '\0';
+      return atoi(buf);
+    }
+    while (len && dir[len-1] != '/') --len;
+    if (len) --len;
+  }
+  return -1;
+}
+
+
+void dump_numa(void)
+{
+  if (num_nodes < 0) discover_nodes();
+  for (int i = 0; i < num_nodes; ++i)
+  {
+    struct node *const n = &nodes[i];
+    // If we're not tracking pressure, nobody else has sampled the nodes.
+    if ((!numa_pressure || num_nodes < 2) && !sample_node(n)) continue;
+    logm(LOG_INFO,
+	"node %d: %lld total, %lld free, %lld file (%lld inactive); "
+	"%lld misses, %lld foreign (%+lld)%s",
+	n->id,
+	n->total,
+	n->free,
+	n->active_file + n->inactive_file,
+	n->inactive_file,
+	n->miss,
+	n->foreign,
+	n->foreign_delta,
+	n->pressured ? "; under pressure" : "");
+  }
+  if (num_nodes > 1)
+  {
+    if (swapdir_node == -2) swapdir_node = numa_path_node(".");
+    logm(LOG_INFO, "swap directory storage on node %d", swapdir_node);
+  }
+}
@@ -0,0 +1,54 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_NUMA_H
+#define SWAPSPACE_NUMA_H
+
+#include "main.h"
+#include "memory.h"
+
+/* On a NUMA machine, one memory node can be deep in reclaim while another is
+ * half empty.  Processes bound to the busy node (or preferring it, with zone
+ * reclaim enabled) get no relief from free memory elsewhere; what they need is
+ * swap.  Global totals hide all of that, so if numa_pressure is set we also
+ * look at each node by itself.
+ */
+
+/// Swap space wanted by memory nodes under pressure.  Clobbers localbuf.
+/** A node is under pressure when its free memory, counting inactive page cache,
+ * is below numa_pressure percent of its size.  It wants enough swap to make up
+ * the difference.
+ *
+ * @return Bytes of swap wanted; zero if none, if numa_pressure is not set, or
+ * if there is only one node
+ */
+memsize_t numa_demand(void);
+
+/// NUMA node of the block device holding path
+/**
+ * @return Node number, or -1 if unknown (e.g. for device mapper volumes)
+ */
+int numa_path_node(const char path[]);
+
+/// Log per-node memory figures
+void dump_numa(void);
+
+#ifndef NO_CONFIG
+char *set_numa_pressure(long long pct);
+#endif
+
+#endif
@@ -31,11 +31,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 
 #include <sys/param.h>
 
+#include "cgroup.h"
+#include "leak.h"
 #include "memory.h"
+#include "numa.h"
 #include "opts.h"
+#include "pace.h"
+#include "pid.h"
+#include "policy.h"
+#include "psi.h"
 #include "support.h"
 #include "state.h"
 #include "swaps.h"
+#include "thrash.h"
 
 
 static const char copyright[] = "\n"
@@ -68,10 +76,11 @@ static char *set_inspect(long long dummy)
   return NULL;
 }
 
-enum argtype { at_none, at_num, at_str };
+enum argtype { at_none, at_num, at_str, at_limit };
 struct option
 {
   const char *name;
+  /// Short option letter, or zero for options that only have a long form
   char shortopt;
   enum argtype argtype;
   /// Minimum value for integer option, or for string, whether arg is required
@@ -85,44 +94,102 @@ struct option
 /// Available options, sorted alphabetically by long option name
 static const struct option options[] =
 {
+  { "alloc_window",	0,   at_num,  0, 600000, set_alloc_window,
+  "Allocate only if memory ran short throughout the last n ms" },
   { "buffer_elasticity",'B', at_num,  0, 100, set_buffer_elasticity,
   "Consider n% of buffer memory to be \"available\"" },
   { "cache_elasticity",	'C', at_num,  0, 100, set_cache_elasticity,
   "Consider n% of cache memory to be \"available\"" },
+  { "cgroup_pressure",	0,   at_num,  1, 100, set_cgroup_pressure,
+  "Consider a cgroup under pressure at n% of its memory limit" },
+  { "cgroup_root",	0,   at_str,  0, PATH_MAX, set_cgroup_root,
+  "Watch memory cgroups below directory s (empty: off)" },
+  { "cgroup_swap_share",0,   at_num,  0, 1000, set_cgroup_swap_share,
+  "Divide n% of all swap among memory cgroups by memory limit (0: off)" },
+  { "chunk_growth",	0,   at_num,  0, 1000, set_chunk_growth,
+  "Make each swapfile in a burst n% the size of the one before (0: off)" },
+  { "commit_headroom",	0,   at_limit, 0, 99, set_commit_headroom,
+  "Under strict overcommit, keep n% (or n bytes) of CommitLimit free" },
   { "configfile",	'c', at_str,  1, PATH_MAX, set_configfile,
   "Use configuration file s" },
   { "cooldown",		'a', at_num,  0, LONG_MAX, set_cooldown,
   "Give allocation attempts n seconds to settle" },
   { "daemon",		'd', at_none, 0, 0, set_daemon,
   "Run quietly in background" },
+  { "elasticity_range",	0,   at_num,  0, 100, set_elasticity_range,
+  "Learn elasticities up to n% away from configured ones (0: off)" },
   { "erase",		'e', at_none, 0, 0, set_erase,
   "Try to free up all swapfiles, then exit" },
-  { "freetarget", 	'f', at_num,  2, 99, set_freetarget,
-  "Aim for n% of available space" },
+  { "fastpath_margin",	0,   at_num,  0, 100, set_fastpath_margin,
+  "Read /proc/meminfo only within n% of a freelimit (0: always)" },
+  { "free_window",	0,   at_num,  0, 3600000, set_free_window,
+  "Free swap only if in excess throughout the last n ms" },
+  { "freetarget", 	'f', at_limit, 2, 99, set_freetarget,
+  "Aim for n% (or n bytes, or the lesser) of available space" },
   { "help",		'h', at_none, 0, 0, set_help,
   "Display usage information" },
   { "inspect",		'i', at_none, 0, 0, set_inspect,
   "Verify that configuration is okay, then exit" },
-  { "lower_freelimit",	'l', at_num,  0, 99, set_lower_freelimit,
-  "Try to keep at least n% of memory/swap available" },
+  { "leak_hook",	0,   at_str,  0, PATH_MAX, set_leak_hook,
+  "Run command s with pid and growth when a process leaks (empty: none)" },
+  { "leak_share",	0,   at_num,  0, 100, set_leak_share,
+  "Stop adding swap once a process causes n% of memory growth (0: off)" },
+  { "lower_freelimit",	'l', at_limit, 0, 99, set_lower_freelimit,
+  "Try to keep at least n% (or n bytes) of memory/swap available" },
+  { "max_cooldown",	0,   at_num,  0, LONG_MAX, set_max_cooldown,
+  "Let cooldown time grow to n seconds if swap use oscillates" },
+  { "max_interval",	0,   at_num,  1000, 3600000, set_max_interval,
+  "Check memory at least every n ms, even when idle" },
   { "max_swapsize",	'M', at_num, 8192, LLONG_MAX, set_max_swapsize,
   "Restrict swapfiles to n bytes" },
+  { "min_cooldown",	0,   at_num,  0, LONG_MAX, set_min_cooldown,
+  "Let cooldown time shrink to n seconds if swap use is calm" },
+  { "min_interval",	0,   at_num,  10, 1000, set_min_interval,
+  "Check memory at most every n ms, even when it's running out" },
   { "min_swapsize",	'm', at_num, 8192, LLONG_MAX, set_min_swapsize,
   "Don't create swapfiles smaller than n bytes" },
+  { "numa_pressure",	0,   at_num,  0, 100, set_numa_pressure,
+  "Keep free swap for NUMA nodes with under n% free (0: off)" },
   { "paranoid",		'P', at_none, 0, 0, set_paranoid,
   "Wipe disk space occupied swapfiles after use" },
+  { "pid_control",	0,   at_none, 0, 0, set_pid_control,
+  "Same as policy=pid" },
+  { "pid_kd",		0,   at_num,  0, 100000, set_pid_kd,
+  "Derivative gain of PID controller, in hundredths of seconds" },
+  { "pid_ki",		0,   at_num,  0, 10000, set_pid_ki,
+  "Integral gain of PID controller, in hundredths per second" },
+  { "pid_kp",		0,   at_num,  0, 10000, set_pid_kp,
+  "Proportional gain of PID controller, in hundredths" },
   { "pidfile",		'p', at_str,  0, PATH_MAX, set_pidfile,
   "Write process identifier to file s" },
+  { "policy",		0,   at_str,  1, 15, set_policy,
+  "Size swap space by policy s (freetarget, pid, exponential, fixed_step)" },
+  { "policy_step",	0,   at_num, 8192, LLONG_MAX, set_policy_step,
+  "Allocate and free n bytes at a time under the fixed_step policy" },
+  { "psi_stall",	0,   at_num,  0, 10000, set_psi_stall,
+  "Act once memory stalls reach n ms per window (0: off)" },
+  { "psi_window",	0,   at_num,  500, 10000, set_psi_window,
+  "Watch memory pressure over windows of n ms" },
   { "quiet",		'q', at_none, 0, 0, set_quiet,
   "Suppress informational output" },
   { "swappath",		's', at_str,  1, PATH_MAX, set_swappath,
   "Create swapfiles in secure directory s" },
-  { "upper_freelimit",	'u', at_num,  0, 100, set_upper_freelimit,
-  "Reduce swapspace if more than n% is free" },
+  { "thrash_allocstall",0,   at_num,  0, 1000000, set_thrash_allocstall,
+  "Consider n allocation stalls per second thrashing (0: off)" },
+  { "thrash_majfault",	0,   at_num,  0, 1000000, set_thrash_majfault,
+  "Consider n major page faults per second thrashing (0: off)" },
+  { "thrash_swapin",	0,   at_num,  0, 1000000, set_thrash_swapin,
+  "Consider n pages swapped in per second thrashing (0: off)" },
+  { "tmpfs_swap",	0,   at_num,  0, 100, set_tmpfs_swap,
+  "Keep enough free swap to evict n% of tmpfs/shared memory (0: off)" },
+  { "upper_freelimit",	'u', at_limit, 0, 100, set_upper_freelimit,
+  "Reduce swapspace if more than n% (or n bytes) is free" },
   { "verbose",		'v', at_none, 0, 0, set_verbose,
   "Print lots of debug information" },
   { "version",		'V', at_none, 0, 0, set_version,
-  "Print version number and exit" }
+  "Print version number and exit" },
+  { "watermarks",	0,   at_none, 0, 0, set_watermarks,
+  "Allocate as the kernel's zone watermarks come near" }
 };
 
 
@@ -155,6 +222,7 @@ static bool options_okay(void)
       return false;
     }
   }
+  memset(localbuf, 0, 128);
   localbuf[(unsigned char)options[0].shortopt] = true;
   for (int i=1; i<num_opts; ++i)
   {
@@ -166,7 +234,7 @@ static bool options_okay(void)
 	  options[i].name);
       return false;
     }
-    if (localbuf[(unsigned char)options[i].shortopt])
+    if (options[i].shortopt && localbuf[(unsigned char)options[i].shortopt])
     {
       fprintf(stderr,
 	  "Option %s re-uses shortopt '%c'\n",
@@ -174,6 +242,7 @@ static bool options_okay(void)
 	  options[i].shortopt);
       return false;
     }
+    localbuf[(unsigned char)options[i].shortopt] = true;
   }
   return true;
 }
@@ -187,6 +256,7 @@ static const char *argproto(int opt, bool shortopt)
   case at_none: break;
   case at_num: result = (shortopt ? " n" : "=n"); break;
   case at_str: result = (shortopt ? " s" : "=s"); break;
+  case at_limit: result = (shortopt ? " n" : "=n"); break;
   }
   return result;
 }
@@ -213,10 +283,12 @@ static char *set_help(long long dummy)
     ptlen = strlen(pt);
     assert(ptlen < strlen(pad));
 
-    printf("  -%c%s,%s--%s%s%*s\t%s\n",
-	options[i].shortopt,
-	pt,
-	pad+ptlen,
+    if (options[i].shortopt)
+      printf("  -%c%s,%s", options[i].shortopt, pt, pad+ptlen);
+    else
+      printf("  %*s", (int)(3+strlen(pad)), "");
+
+    printf("--%s%s%*s\t%s\n",
 	options[i].name,
 	argproto(i, false),
 	(int)(longestopt+2-strlen(options[i].name)-2*strlen(pt)),
@@ -273,6 +345,74 @@ static bool value_error(const char keyword[], const char msg[])
 }
 
 
+/// Multiplier for unit letter, or 0 if invalid
+static long long unit_multiplier(char unit)
+{
+  switch (tolower(unit))
+  {
+  case 'k': return KILO;
+  case 'm': return MEGA;
+  case 'g': return GIGA;
+  case 't': return TERA;
+  }
+  return 0;
+}
+
+
+/// Parse a free-space limit.  Returns error message, or NULL on success.
+/** Accepts a percentage ("20" or "20%", with up to two decimals as in "0.5%"),
+ * a size with a unit letter ("16g"), or both separated by a comma ("20%,16g")
+ * meaning whichever is less.  A plain number is a percentage, as it always has
+ * been.  The option's minimum and maximum apply to the percentage.
+ */
+static const char *parse_limit(const struct option *opt,
+    const char value[],
+    struct limit *limit)
+{
+  limit->hundredths = -1;
+  limit->bytes = -1;
+
+  const char *p = value;
+  do
+  {
+    if (*p == ',') ++p;
+    if (*p < '0' || *p > '9') return "invalid limit";
+    char *endptr;
+    const long long n = strtoll(p, &endptr, 10);
+    p = endptr;
+
+    const long long unit = unit_multiplier(*p);
+    if (unit)
+    {
+      if (limit->bytes >= 0) return "more than one size given";
+      if (n > LLONG_MAX/unit) return "given value too large";
+      limit->bytes = n*unit;
+      ++p;
+    }
+    else
+    {
+      if (limit->hundredths >= 0) return "more than one percentage given";
+      if (n > opt->max) return "given value too large";
+      long long h = n*100;
+      if (*p == '.')
+      {
+	++p;
+	for (int scale = 10; scale && *p >= '0' && *p <= '9'; scale /= 10)
+	  h += (*p++ - '0') * scale;
+	if (*p >= '0' && *p <= '9') return "too many decimals";
+      }
+      if (*p == '%') ++p;
+      if (h < opt->min*100) return "given value too small";
+      if (h > opt->max*100) return "given value too large";
+      limit->hundredths = (int)h;
+    }
+  } while (*p == ',');
+
+  if (*p) return "invalid limit";
+  return NULL;
+}
+
+
 static bool handle_configitem(const char keyword[], const char *value)
 {
   const struct option keyopt = { keyword, 0, 0, 0, 0 };
@@ -286,6 +426,7 @@ static bool handle_configitem(const char keyword[], const char *value)
   if (!opt) return value_error(keyword, "unknown configuration item");
 
   long long numarg = 0;
+  struct limit limit;
   size_t arglen = 0;
   if (value) arglen = strlen(value);
 
@@ -302,13 +443,11 @@ static bool handle_configitem(const char keyword[], const char *value)
       char *endptr;
       numarg = strtoll(value, &endptr, 0);
 
-      if (*endptr) switch (tolower(*endptr++))
+      if (*endptr)
       {
-      case 'k': numarg *= KILO; break;
-      case 'm': numarg *= MEGA; break;
-      case 'g': numarg *= GIGA; break;
-      case 't': numarg *= TERA; break;
-      default: err = "invalid unit letter";
+	const long long unit = unit_multiplier(*endptr++);
+	if (unit) numarg *= unit;
+	else err = "invalid unit letter";
       }
 
       if (*endptr) err = "invalid numeric argument";
@@ -324,15 +463,24 @@ static bool handle_configitem(const char keyword[], const char *value)
   case at_str:
     if (arglen > opt->max) err = "string too long";
     break;
+  case at_limit:
+    err = parse_limit(opt, value, &limit);
+    break;
   }
-  else if (opt->argtype == at_num || (opt->argtype == at_str && opt->min))
+  else if (opt->argtype == at_num ||
+      opt->argtype == at_limit ||
+      (opt->argtype == at_str && opt->min))
   {
     err = "requires an argument";
   }
   if (err) return value_error(keyword, err);
 
-  char *const strdest = opt->setter(numarg);
-  if (strdest && value) strcpy(strdest, value);
+  char *const dest = opt->setter(numarg);
+  if (dest && value)
+  {
+    if (opt->argtype == at_limit) *(struct limit *)dest = limit;
+    else strcpy(dest, value);
+  }
 
   return true;
 }
@@ -501,6 +649,10 @@ bool configure(int argc, char *argv[])
 
   if (!main_check_config() ||
       !memory_check_config() ||
+      !cgroup_check_config() ||
+      !policy_check_config() ||
+      !psi_check_config() ||
+      !state_check_config() ||
       !swaps_check_config() ||
       !swapfs_large_enough())
     return false;
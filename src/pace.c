@@ -0,0 +1,132 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <time.h>
+
+#include "log.h"
+#include "memory.h"
+#include "pace.h"
+#include "state.h"
+
+/* A fixed sampling rate is too slow when a program is eating memory as fast as
+ * it can, and needlessly fast on a machine that's been sitting idle for hours.
+ * So we watch how fast free space is changing.  If it's falling, we estimate
+ * how long until it hits lower_freelimit and sample often enough to see that
+ * coming.  If we're in "steady" state and nothing much is moving, we gradually
+ * back off.
+ *
+ * None of this affects the state machine's timers, which run on real time.
+ */
+
+/// Normal interval between iterations, in milliseconds
+#define BASE_INTERVAL 1000
+
+/// Configuration item: shortest interval between iterations, in milliseconds
+static int min_interval = 50;
+/// Configuration item: longest interval between iterations, in milliseconds
+static int max_interval = 5000;
+
+#ifndef NO_CONFIG
+char *set_min_interval(long long msecs)
+{
+  min_interval = (int)msecs;
+  return NULL;
+}
+char *set_max_interval(long long msecs)
+{
+  max_interval = (int)msecs;
+  return NULL;
+}
+#endif
+
+
+/// Rate of change in free space considered "flat," in tenths of a percent/sec
+#define FLAT_RATE 0.1
+
+/// How many samples we'd like to take before free space hits the lower limit
+#define SAMPLES_AHEAD 10
+
+static int interval = BASE_INTERVAL;
+
+/// Smoothed rate of change in free space, in tenths of a percent per second
+static double rate = 0;
+
+static long long last_msecs = -1;
+static int last_headroom = 0;
+
+
+static long long now_msecs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec*1000LL + ts.tv_nsec/1000000;
+}
+
+
+static int clamp(int msecs, int lo, int hi)
+{
+  if (msecs < lo) return lo;
+  if (msecs > hi) return hi;
+  return msecs;
+}
+
+
+int pace_interval(void)
+{
+  const long long now = now_msecs();
+  const int headroom = memory_headroom();
+
+  if (last_msecs >= 0 && now > last_msecs)
+  {
+    // Exponentially weighted moving average, so one odd sample won't throw us.
+    const double current = (headroom-last_headroom)*1000.0/(now-last_msecs);
+    rate = (rate + current) / 2;
+  }
+  last_msecs = now;
+  last_headroom = headroom;
+
+  if (rate < -FLAT_RATE)
+  {
+    // Falling.  If we're already below the limit, hurry.
+    const double secs_left = (headroom > 0) ? headroom / -rate : 0;
+    interval = clamp((int)(secs_left*1000/SAMPLES_AHEAD),
+	min_interval,
+	BASE_INTERVAL);
+  }
+  else if (rate <= FLAT_RATE && state_steady())
+  {
+    // Calm.  Relax a bit more.
+    interval = clamp(interval*2, BASE_INTERVAL, max_interval);
+  }
+  else
+  {
+    interval = BASE_INTERVAL;
+  }
+
+  return clamp(interval, min_interval, max_interval);
+}
+
+
+void dump_pace(void)
+{
+  logm(LOG_INFO,
+      "sampling every %d ms; free space changing by %.2f%%/s",
+      clamp(interval, min_interval, max_interval),
+      rate/10);
+}
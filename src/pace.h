@@ -0,0 +1,38 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_PACE_H
+#define SWAPSPACE_PACE_H
+
+#include "main.h"
+
+/// Decide how long to wait until the next iteration, in milliseconds
+/** Call after every iteration of the allocation algorithm.  Samples faster as
+ * free space falls towards lower_freelimit, and backs off while things are
+ * steady and calm.
+ */
+int pace_interval(void);
+
+/// Log current sampling rate
+void dump_pace(void);
+
+#ifndef NO_CONFIG
+char *set_min_interval(long long msecs);
+char *set_max_interval(long long msecs);
+#endif
+
+#endif
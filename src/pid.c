@@ -0,0 +1,144 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include "log.h"
+#include "pid.h"
+#include "support.h"
+
+/* By default, swap space is managed bang-bang: nothing happens while free space
+ * stays between the freelimits, and once it crosses one, we jump straight to
+ * freetarget.  As an alternative, a PID controller can steer free space towards
+ * freetarget all the time, moving swap capacity a little at a time.  The
+ * memory module turns the controller's output into swapfile sizes.
+ */
+
+/// Configuration items: controller gains, in hundredths
+/** The proportional gain is a plain factor; the integral gain is per second of
+ * accumulated error, and the derivative gain is in seconds.
+ */
+static int pid_kp = 50, pid_ki = 2, pid_kd = 0;
+
+#ifndef NO_CONFIG
+char *set_pid_kd(long long gain)
+{
+  pid_kd = (int)gain;
+  return NULL;
+}
+char *set_pid_ki(long long gain)
+{
+  pid_ki = (int)gain;
+  return NULL;
+}
+char *set_pid_kp(long long gain)
+{
+  pid_kp = (int)gain;
+  return NULL;
+}
+#endif
+
+
+/// Most the integral term may contribute, in percentage points
+#define PID_INTEGRAL_MAX 10
+
+/// Longest time step we integrate over (in seconds)
+/** After a suspend, or a long stretch of time without samples, we don't know
+ * what the error was in the meantime.
+ */
+#define PID_MAX_STEP 60
+
+/// Shortest time step we take (in seconds)
+/** Besides the regular ticks, we get snapshots on memory pressure, hotplug
+ * events and the like, sometimes milliseconds apart.  Over such short steps the
+ * slope is mostly noise, and each would count as an extra integration step.
+ * Those snapshots get the controller's output, but don't move it.
+ */
+#define PID_MIN_STEP 1
+
+/// Accumulated error, in percentage point-seconds
+static double integral = 0;
+/// Smoothed rate of change in the process variable, in points per second
+static double slope = 0;
+
+static double last_pv = 0;
+static struct timespec last_taken;
+static bool sampled = false;
+
+
+/// Seconds from a to b
+static double secs_between(const struct timespec *a, const struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+
+void pid_sample(const struct timespec *taken,
+    double setpoint,
+    double pv,
+    double deadband,
+    struct pid_terms *terms)
+{
+  double dt = sampled ? secs_between(&last_taken, taken) : 0;
+  const bool step = !sampled || dt >= PID_MIN_STEP;
+  if (step)
+  {
+    if (dt > PID_MAX_STEP) dt = PID_MAX_STEP;
+    // Halve the old slope's weight at each step; a single jump in free space
+    // then moves the derivative term only half as far.
+    if (dt > 0) slope = (slope + (pv - last_pv)/dt) / 2;
+    last_pv = pv;
+    last_taken = *taken;
+    sampled = true;
+  }
+
+  const double kp = pid_kp/100.0, ki = pid_ki/100.0, kd = pid_kd/100.0;
+  terms->error = setpoint - pv;
+  terms->p = kp * terms->error;
+  // Derivative of the measurement, not of the error: when the setpoint moves
+  // along with total space, that's no reason for a kick.
+  terms->d = -kd * slope;
+
+  double next = integral;
+  if (step && ki > 0)
+  {
+    const double most = PID_INTEGRAL_MAX / ki;
+    next = integral + terms->error*dt;
+    if (next > most) next = most;
+    if (next < -most) next = -most;
+  }
+  const double output = terms->p + ki*next + terms->d;
+  // Integrate only while the actuator is idle, or to unwind.
+  if ((output > -deadband && output < deadband) ||
+      next*next < integral*integral)
+    integral = next;
+
+  terms->i = ki * integral;
+  terms->output = terms->p + terms->i + terms->d;
+}
+
+
+void dump_pid(const struct pid_terms *terms)
+{
+  logm(LOG_INFO,
+      "controller: error %.2f, P %.2f, I %.2f, D %.2f, output %.2f points",
+      terms->error,
+      terms->p,
+      terms->i,
+      terms->d,
+      terms->output);
+}
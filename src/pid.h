@@ -0,0 +1,64 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_PID_H
+#define SWAPSPACE_PID_H
+
+#include <time.h>
+
+#include "main.h"
+
+/// The PID controller's latest output, broken down by term
+/** All in percentage points of free space.
+ */
+struct pid_terms
+{
+  /// Setpoint minus process variable; positive if free space is short
+  double error;
+  /// Proportional, integral, and derivative terms
+  double p, i, d;
+  /// Sum of the terms: how far to move free space, by changing swap capacity
+  double output;
+};
+
+/// Feed the controller a new sample, and compute its output
+/** The integral term only builds up while the output is within the deadband,
+ * i.e. too small for the actuator to act on.  That way it can't wind up while
+ * an allocation is already on its way.  Its contribution is also capped.
+ *
+ * @param taken When the sample was taken (CLOCK_MONOTONIC)
+ * @param setpoint Desired percentage of free space
+ * @param pv Actual percentage of free space
+ * @param deadband Smallest output, in percentage points, that we can act on
+ * @param terms Receives the controller's output
+ */
+void pid_sample(const struct timespec *taken,
+    double setpoint,
+    double pv,
+    double deadband,
+    struct pid_terms *terms);
+
+/// Log controller terms
+void dump_pid(const struct pid_terms *terms);
+
+#ifndef NO_CONFIG
+char *set_pid_kd(long long gain);
+char *set_pid_ki(long long gain);
+char *set_pid_kp(long long gain);
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/param.h>
+
+#include "log.h"
+#include "opts.h"
+#include "policy.h"
+#include "support.h"
+#include "swaps.h"
+
+/* A sizing policy decides, from a snapshot of the system, whether to allocate
+ * or free swap space and how much.  They trade off differently between how
+ * often we have to stop and create a swapfile, and how much disk space sits
+ * idle as swap.  Everything downstream--the sliding windows, the state
+ * machine's timers, and the extra needs that the memory module adds in on its
+ * own account--is the same for all of them.
+ *
+ * To add a policy, write a function that makes the recommendation and add it
+ * to the policies[] table.
+ */
+
+/// Longest policy name
+#define POLICY_NAME_MAX 15
+
+/// Configuration item: name of the sizing policy to use
+static char policy_name[POLICY_NAME_MAX+1] = "freetarget";
+
+/// Configuration item: swapfile size for the fixed_step policy
+static memsize_t policy_step = 256*MEGA;
+
+#ifndef NO_CONFIG
+char *set_policy(long long dummy)
+{
+  return policy_name;
+}
+char *set_policy_step(long long size)
+{
+  policy_step = (memsize_t)size;
+  return NULL;
+}
+char *set_pid_control(long long dummy)
+{
+  strcpy(policy_name, "pid");
+  return NULL;
+}
+#endif
+
+
+/// Swap to add when allocations are stalling in direct reclaim
+/** Free space may still look plentiful overall, making the ideal size zero or
+ * negative; but this is no time to free swap.
+ */
+static inline memsize_t breach_request(const struct policy_input *in)
+{
+  return MAX(MAX(in->ideal, in->anticipated), swapfile_quantum());
+}
+
+
+/// Default policy: once we hit either freelimit, steer for freetarget
+static memsize_t freetarget_policy(const struct policy_input *in)
+{
+  if (in->breached) return breach_request(in);
+  if (in->freespace < in->lower || in->freespace > in->upper)
+    return in->ideal;
+  return in->anticipated;
+}
+
+
+/// Follow the PID controller, but don't let it dawdle below the lower limit
+/** The controller's output is a change in the percentage of free space; we
+ * solve for the amount of swap that brings that about, like we do for
+ * freetarget.  The result is rounded towards zero, to a multiple of the
+ * smallest swapfile.
+ */
+static memsize_t pid_policy(const struct policy_input *in)
+{
+  if (unlikely(in->total <= 0) || unlikely(in->setpoint >= 100)) return 0;
+  const memsize_t quantum = swapfile_quantum();
+  const double bytes = in->snap->control.output * in->total /
+    (100 - in->setpoint);
+  memsize_t request = (memsize_t)bytes / quantum * quantum;
+
+  if (in->breached) return MAX(request, breach_request(in));
+  if (in->freespace < in->lower && in->ideal > request)
+    request = in->ideal;
+  return request;
+}
+
+
+/// Like freetarget, but always in swapfiles of policy_step bytes
+/** The disk footprint moves in predictable, even steps; but a large shortage
+ * takes several allocations, one per tick at best.
+ */
+static memsize_t fixed_step_policy(const struct policy_input *in)
+{
+  const memsize_t request = freetarget_policy(in);
+  if (request > 0) return policy_step;
+  if (request <= -policy_step) return -policy_step;
+  return 0;
+}
+
+
+struct policy
+{
+  const char *name;
+  /// Recommend change in swap space, as policy_target() does
+  memsize_t (*target)(const struct policy_input *in);
+  /// Does this policy need the PID controller fed?
+  bool controlled;
+  /// Default chunk growth in percent, as policy_chunk_growth() returns
+  int chunk_growth;
+};
+
+/* The "exponential" policy is freetarget, with swapfiles doubling in size while
+ * memory keeps running short.  Growing swapfiles within a burst is what the
+ * swaps module's chunk sizing does, so that's where it happens; this policy
+ * just sets its default growth.
+ */
+static const struct policy policies[] =
+{
+  { "freetarget",	freetarget_policy,	false,	0 },
+  { "pid",		pid_policy,		true,	0 },
+  { "exponential",	freetarget_policy,	false,	200 },
+  { "fixed_step",	fixed_step_policy,	false,	0 }
+};
+
+#define NUM_POLICIES (sizeof(policies)/sizeof(*policies))
+
+/// The policy in use; resolved from policy_name when configuration is checked
+static const struct policy *the_policy = &policies[0];
+
+
+#ifndef NO_CONFIG
+bool policy_check_config(void)
+{
+  for (size_t i = 0; i < NUM_POLICIES; ++i)
+    if (strcmp(policy_name, policies[i].name) == 0)
+    {
+      the_policy = &policies[i];
+      return true;
+    }
+
+  fprintf(stderr, "Unknown policy '%s'.  Choose from:", policy_name);
+  for (size_t i = 0; i < NUM_POLICIES; ++i)
+    fprintf(stderr, " %s", policies[i].name);
+  fputc('\n', stderr);
+  return false;
+}
+#endif
+
+
+memsize_t policy_target(const struct policy_input *in)
+{
+  return the_policy->target(in);
+}
+
+
+bool policy_controlled(void)
+{
+  return the_policy->controlled;
+}
+
+
+int policy_chunk_growth(void)
+{
+  return the_policy->chunk_growth;
+}
+
+
+void dump_policy(void)
+{
+  logm(LOG_INFO, "policy: %s", the_policy->name);
+}
@@ -0,0 +1,74 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_POLICY_H
+#define SWAPSPACE_POLICY_H
+
+#include "main.h"
+#include "memory.h"
+#include "snapshot.h"
+
+/// What a sizing policy gets to base its recommendation on
+/** The memory module fills this in from a snapshot.  If the snapshot's meminfo
+ * is not set, a quick look showed we're comfortably between both freelimits,
+ * and the figures are estimates.
+ */
+struct policy_input
+{
+  /// The snapshot, including its forecast and PID controller output
+  const struct snapshot *snap;
+  /// Total space, memory plus swap, and free space, in bytes
+  memsize_t total, freespace;
+  /// Free space at lower_freelimit and upper_freelimit, in bytes
+  memsize_t lower, upper;
+  /// Have any memory zones dropped below their min watermarks?
+  bool breached;
+  /// Swap to add (or if negative, remove) to get to freetarget in one go
+  memsize_t ideal;
+  /// Swap to add ahead of time, as lower_freelimit is forecast to come near
+  memsize_t anticipated;
+  /// freetarget, as a percentage of total space
+  double setpoint;
+};
+
+/// Recommend change in swap space, according to the configured policy
+/**
+ * @return Bytes of swap to add; negative to remove swap; zero to hold
+ */
+memsize_t policy_target(const struct policy_input *in);
+
+/// Does the configured policy need the PID controller fed?
+bool policy_controlled(void);
+
+/// Growth of swapfiles within a burst that the policy calls for, if any
+/** Applies unless chunk_growth is configured.
+ * @return Each swapfile's size as a percentage of the one before, or 0
+ */
+int policy_chunk_growth(void);
+
+/// Log which policy is in use
+void dump_policy(void);
+
+#ifndef NO_CONFIG
+char *set_policy(long long dummy);
+char *set_policy_step(long long size);
+char *set_pid_control(long long dummy);
+
+bool policy_check_config(void);
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+
+#include "log.h"
+#include "procfile.h"
+#include "support.h"
+
+
+ssize_t procfile_read(struct procfile *pf)
+{
+  if (unlikely(pf->fd == -1))
+  {
+    pf->fd = open(pf->path, O_RDONLY|O_CLOEXEC);
+    if (unlikely(pf->fd == -1))
+    {
+      log_perr_str(LOG_ERR, "Could not open", pf->path, errno);
+      return -1;
+    }
+  }
+
+  /* Files in /proc are generated afresh whenever they are read from the start,
+   * so there is no need to reopen them.  Leave room for a terminating nul.
+   */
+  ssize_t len = pread(pf->fd, localbuf, sizeof(localbuf)-1, 0);
+  if (unlikely(len == -1) && errno == EINTR)
+    len = pread(pf->fd, localbuf, sizeof(localbuf)-1, 0);
+  if (unlikely(len == -1))
+  {
+    log_perr_str(LOG_ERR, "Could not read", pf->path, errno);
+    close(pf->fd);
+    pf->fd = -1;
+    return -1;
+  }
+
+  localbuf[len] = '\0';
+  return len;
+}
+
+
+memsize_t procfile_number(struct procfile *pf)
+{
+  if (procfile_read(pf) <= 0) return -1;
+  memsize_t v = 0;
+  const char *p;
+  for (p = localbuf; *p >= '0' && *p <= '9'; ++p) v = v*10 + (*p - '0');
+  return (p > localbuf) ? v : -1;
+}
+
+
+bool procfile_lines(struct procfile *pf,
+    void (*handle)(const char line[], size_t len, void *arg),
+    void *arg)
+{
+  if (unlikely(pf->fd == -1))
+  {
+    pf->fd = open(pf->path, O_RDONLY|O_CLOEXEC);
+    if (unlikely(pf->fd == -1))
+    {
+      log_perr_str(LOG_ERR, "Could not open", pf->path, errno);
+      return false;
+    }
+  }
+
+  off_t offset = 0;
+  size_t kept = 0;
+  for (;;)
+  {
+    ssize_t len = pread(pf->fd, localbuf+kept, sizeof(localbuf)-1-kept, offset);
+    if (unlikely(len == -1) && errno == EINTR)
+      len = pread(pf->fd, localbuf+kept, sizeof(localbuf)-1-kept, offset);
+    if (unlikely(len == -1))
+    {
+      log_perr_str(LOG_ERR, "Could not read", pf->path, errno);
+      close(pf->fd);
+      pf->fd = -1;
+      return false;
+    }
+    offset += len;
+    const size_t end = kept + len;
+
+    // Pass on all complete lines; keep any partial line for the next round.
+    size_t start = 0;
+    for (size_t i = start; i < end; ++i) if (localbuf[i] == '\n')
+    {
+      localbuf[i] = '\0';
+      handle(localbuf+start, i-start, arg);
+      start = i+1;
+    }
+    kept = end - start;
+
+    if (!len || kept == sizeof(localbuf)-1)
+    {
+      // End of file, or a line too long for our buffer.  Pass on what we have.
+      if (kept)
+      {
+	localbuf[end] = '\0';
+	handle(localbuf+start, kept, arg);
+      }
+      if (!len) return true;
+      kept = 0;
+    }
+    else if (start)
+    {
+      memmove(localbuf, localbuf+start, kept);
+    }
+  }
+}
+
+
+static inline bool is_blank(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+
+/// Parse scale factor at end of line, e.g. "kB".  Returns zero if unknown.
+/** I've never seen it be anything other than "kB", but who knows what can
+ * happen...  Since Linux 2.6.18-mm4 or so, /proc/meminfo may contain lines
+ * without a unit or "factor" attached.
+ */
+static memsize_t unit_scale(const char unit[], size_t len)
+{
+  switch (len)
+  {
+  case 0:
+    return 1;
+  case 3:
+    if (unit[1] != 'i') return 0;
+    // FALL-THROUGH
+  case 2:
+    if (unit[len-1] != 'B') return 0;
+    // FALL-THROUGH
+  case 1:
+    switch (unit[0])
+    {
+    case 'b': case 'B': return 1;
+    case 'k': case 'K': return KILO;
+    case 'm': case 'M': return MEGA;
+    case 'g': case 'G': return GIGA;
+    }
+  }
+  return 0;
+}
+
+
+bool procfile_field(const char **pos, struct procfield *field)
+{
+  const char *p = *pos;
+
+  while (*p)
+  {
+    // Field name runs up to the colon (if any) or whitespace.
+    const char *const name = p;
+    while (*p && *p != ':' && *p != '\n' && !is_blank(*p)) ++p;
+    const size_t namelen = p - name;
+    if (*p == ':') ++p;
+    while (is_blank(*p)) ++p;
+
+    const bool negative = (*p == '-');
+    if (negative) ++p;
+    const char *const digits = p;
+    memsize_t value = 0;
+    while (*p >= '0' && *p <= '9') value = value*10 + (*p++ - '0');
+    const bool have_value = (p > digits);
+
+    while (is_blank(*p)) ++p;
+    const char *const unit = p;
+    while (*p && *p != '\n' && !is_blank(*p)) ++p;
+    const memsize_t scale = unit_scale(unit, p - unit);
+
+    // Skip whatever else is on this line.  In Linux 2.4, /proc/meminfo starts
+    // with a table of numbers; those lines fail to parse, and we skip them.
+    while (*p && *p != '\n') ++p;
+    if (*p) ++p;
+
+    if (likely(namelen && have_value && scale))
+    {
+      field->name = name;
+      field->namelen = namelen;
+      field->value = (negative ? -value : value) * scale;
+      *pos = p;
+      return true;
+    }
+  }
+
+  *pos = p;
+  return false;
+}
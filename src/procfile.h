@@ -0,0 +1,91 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_PROCFILE_H
+#define SWAPSPACE_PROCFILE_H
+
+#include <string.h>
+
+#include <sys/types.h>
+
+#include "main.h"
+#include "memory.h"
+
+/// A file in /proc or /sys that we sample over and over
+/** The file is opened on first use and then kept open; every sample is a single
+ * pread() from the start of the file.  No stdio, no dynamic allocation.
+ */
+struct procfile
+{
+  const char *path;
+  int fd;
+};
+
+/// Initializer for struct procfile
+#define PROCFILE(PATH) { PATH, -1 }
+
+/// Read file's current contents into localbuf.  Clobbers localbuf.
+/** The text is nul-terminated.  Errors are logged.
+ * @return Number of bytes read, or -1 on failure
+ */
+ssize_t procfile_read(struct procfile *pf);
+
+/// Read a file holding a single number, e.g. a sysctl.  Clobbers localbuf.
+/**
+ * @return The number, or -1 if it could not be read
+ */
+memsize_t procfile_number(struct procfile *pf);
+
+/// Read file a chunk at a time, passing lines to handle().  Clobbers localbuf.
+/** For files that may not fit into localbuf.  Lines are passed without their
+ * terminating newline, but nul-terminated; handle() may modify them, but not
+ * anything else in localbuf.  Errors are logged.
+ *
+ * @return Success
+ */
+bool procfile_lines(struct procfile *pf,
+    void (*handle)(const char line[], size_t len, void *arg),
+    void *arg);
+
+/// A "name: value [unit]" or "name value" line, as found in e.g. /proc/meminfo
+struct procfield
+{
+  /// Field name.  Not nul-terminated!
+  const char *name;
+  size_t namelen;
+  /// Value, multiplied by its unit (if any)
+  memsize_t value;
+};
+
+/// Is this the field called name?
+static inline bool field_is(const struct procfield *f, const char name[])
+{
+  const size_t len = strlen(name);
+  return f->namelen == len && memcmp(f->name, name, len) == 0;
+}
+
+/// Parse the next field out of text read by procfile_read()
+/** Lines that do not look like a field with a numeric value and a known unit
+ * are skipped.
+ *
+ * @param pos Current position in the text; advanced past the field's line
+ * @param field Receives the field's name and value
+ * @return Whether a field was found (false means end of text)
+ */
+bool procfile_field(const char **pos, struct procfield *field);
+
+#endif
@@ -0,0 +1,165 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+#include "log.h"
+#include "opts.h"
+#include "psi.h"
+#include "reactor.h"
+#include "state.h"
+#include "support.h"
+
+/* Pressure Stall Information (Linux 4.20 and up) tells us how much time tasks
+ * spend waiting for memory.  Rather than polling it, we register a trigger: the
+ * kernel wakes us up once tasks have been stalled for psi_stall milliseconds
+ * within any psi_window-millisecond window.  That lets us allocate swap the
+ * moment memory gets tight, instead of up to a full tick later.
+ */
+
+/// Configuration item: stall time per window that wakes us up; 0 disables PSI
+static int psi_stall = 150;
+/// Configuration item: PSI tracking window, in milliseconds
+/** Since Linux 6.5, unprivileged processes may only use windows that are a
+ * multiple of 2 seconds.  We normally run as root, but the default should work
+ * either way.
+ */
+static int psi_window = 2000;
+
+#ifndef NO_CONFIG
+char *set_psi_stall(long long msecs)
+{
+  psi_stall = (int)msecs;
+  return NULL;
+}
+char *set_psi_window(long long msecs)
+{
+  psi_window = (int)msecs;
+  return NULL;
+}
+
+bool psi_check_config(void)
+{
+  // The kernel's limits on the window; anything else fails every trigger.
+  CHECK_CONFIG_ERR(psi_window < 500 || psi_window > 10000);
+  CHECK_CONFIG_ERR(psi_stall > psi_window);
+  return true;
+}
+#endif
+
+
+/// Number of active triggers
+static int num_triggers = 0;
+
+
+/// Kernel reported memory pressure on trigger fd, or the trigger went away
+static void handle_trigger(int fd, uint32_t events)
+{
+  if (unlikely(events & EPOLLERR))
+  {
+    logm(LOG_NOTICE, "Memory pressure trigger went away");
+    reactor_unwatch(fd);
+    close(fd);
+    --num_triggers;
+  }
+  else if (events & EPOLLPRI)
+  {
+    handle_pressure();
+  }
+}
+
+
+/// Register trigger on given pressure file
+static bool add_trigger(const char file[])
+{
+  const int fd = open(file, O_RDWR|O_NONBLOCK|O_CLOEXEC);
+  if (fd == -1)
+  {
+#ifndef NO_CONFIG
+    if (verbose)
+      log_perr_str(LOG_DEBUG, "No memory pressure info in", file, errno);
+#endif
+    return false;
+  }
+
+  char trig[64];
+  snprintf(trig, sizeof(trig), "some %d %d", psi_stall*1000, psi_window*1000);
+  // The kernel wants the terminating nul as part of the write.
+  if (unlikely(write(fd, trig, strlen(trig)+1) < 0))
+  {
+    log_perr_str(LOG_NOTICE, "Could not set memory pressure trigger on",
+	file,
+	errno);
+    close(fd);
+    return false;
+  }
+
+  if (unlikely(!reactor_watch(fd, EPOLLPRI, handle_trigger)))
+  {
+    close(fd);
+    return false;
+  }
+  ++num_triggers;
+#ifndef NO_CONFIG
+  if (verbose) logm(LOG_DEBUG, "Watching memory pressure in %s", file);
+#endif
+  return true;
+}
+
+
+/// Are we at the root of our cgroup namespace?  Clobbers localbuf.
+/** Only a process at the root of its cgroup namespace, i.e. one running in a
+ * container, gets a trigger for its cgroup.  On a host, our own cgroup is just
+ * the swapspace service, whose memory pressure tells us nothing.
+ */
+static bool at_cgroup_root(void)
+{
+  FILE *fp = fopen("/proc/self/cgroup", "r");
+  if (!fp) return false;
+
+  bool found = false;
+  // Look for the unified (cgroup v2) hierarchy, listed as "0::/path".
+  while (!found && fgets(localbuf, sizeof(localbuf), fp))
+    found = (strcmp(localbuf, "0::/\n") == 0);
+  fclose(fp);
+
+  return found;
+}
+
+
+bool psi_start(void)
+{
+  if (!psi_stall) return false;
+
+  add_trigger("/proc/pressure/memory");
+
+  if (at_cgroup_root()) add_trigger("/sys/fs/cgroup/memory.pressure");
+
+#ifndef NO_CONFIG
+  if (!num_triggers && verbose)
+    logm(LOG_DEBUG, "Memory pressure triggers unavailable; relying on tick");
+#endif
+  return num_triggers > 0;
+}
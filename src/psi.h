@@ -0,0 +1,39 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_PSI_H
+#define SWAPSPACE_PSI_H
+
+#include "main.h"
+
+/// Register memory pressure (PSI) triggers with the kernel, if available
+/** Triggers are watched by the reactor, which calls handle_pressure() when
+ * they fire.  Failure to set up triggers is not an error: the kernel may be too
+ * old, or built without PSI support.  In that case we just rely on the tick.
+ *
+ * @return Whether any triggers are active
+ */
+bool psi_start(void);
+
+#ifndef NO_CONFIG
+char *set_psi_stall(long long msecs);
+char *set_psi_window(long long msecs);
+
+bool psi_check_config(void);
+#endif
+
+#endif
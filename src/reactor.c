@@ -0,0 +1,212 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+#include "log.h"
+#include "reactor.h"
+#include "support.h"
+
+/// Timer slack we grant the kernel, so it can batch our wakeups with others'
+/** None of our timing is critical to within a few tens of milliseconds, and on
+ * a host running many idle guests, coalesced wakeups add up.
+ */
+#define TIMER_SLACK_NS (50*1000*1000)
+
+/// Maximum number of file descriptors we can watch
+#define MAX_WATCHES 16
+
+struct watch
+{
+  int fd;
+  fd_handler handler;
+};
+
+/// Registered event sources.  Only the first num_watches are in use.
+static struct watch watches[MAX_WATCHES];
+static int num_watches = 0;
+
+static int epfd = -1;
+static int timerfd = -1;
+static void (*tick_handler)(void) = NULL;
+
+static bool stopped = false;
+
+/// CLOCK_BOOTTIME reading at startup, in seconds
+/** We count time spent suspended, so a cooldown period that spans a suspend
+ * does not drag on for however long the machine was asleep.
+ */
+static time_t epoch = 0;
+
+
+static time_t boottime(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec;
+}
+
+
+void reactor_init(void)
+{
+  epoch = boottime();
+  runclock = 0;
+}
+
+
+bool reactor_start(void)
+{
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (unlikely(epfd == -1))
+  {
+    log_perr(LOG_ERR, "Could not create event loop", errno);
+    return false;
+  }
+
+  if (unlikely(prctl(PR_SET_TIMERSLACK, TIMER_SLACK_NS, 0, 0, 0) == -1))
+    log_perr(LOG_NOTICE, "Could not set timer slack", errno);
+
+  return true;
+}
+
+
+bool reactor_watch(int fd, uint32_t events, fd_handler handler)
+{
+  if (unlikely(num_watches == MAX_WATCHES))
+  {
+    logm(LOG_ERR, "Too many event sources");
+    return false;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if (unlikely(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1))
+  {
+    log_perr(LOG_ERR, "Could not add event source", errno);
+    return false;
+  }
+
+  watches[num_watches].fd = fd;
+  watches[num_watches].handler = handler;
+  ++num_watches;
+  return true;
+}
+
+
+void reactor_unwatch(int fd)
+{
+  for (int i=0; i<num_watches; ++i) if (watches[i].fd == fd)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    watches[i] = watches[--num_watches];
+    return;
+  }
+}
+
+
+/// Timer went off.  If we fell behind, don't try to catch up.
+static void handle_timer(int fd, uint32_t events)
+{
+  uint64_t expirations;
+  if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+    tick_handler();
+}
+
+
+bool reactor_tick(int msecs, void (*handler)(void))
+{
+  if (timerfd == -1)
+  {
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (unlikely(timerfd == -1))
+    {
+      log_perr(LOG_ERR, "Could not create timer", errno);
+      return false;
+    }
+    if (unlikely(!reactor_watch(timerfd, EPOLLIN, handle_timer)))
+    {
+      close(timerfd);
+      timerfd = -1;
+      return false;
+    }
+  }
+
+  tick_handler = handler;
+
+  struct itimerspec its;
+  its.it_interval.tv_sec = msecs / 1000;
+  its.it_interval.tv_nsec = (msecs % 1000) * 1000000L;
+  its.it_value = its.it_interval;
+  if (unlikely(timerfd_settime(timerfd, 0, &its, NULL) == -1))
+  {
+    log_perr(LOG_ERR, "Could not set timer", errno);
+    return false;
+  }
+  return true;
+}
+
+
+/// Find the handler for fd, or NULL if fd was unwatched in the meantime
+static fd_handler find_handler(int fd)
+{
+  for (int i=0; i<num_watches; ++i)
+    if (watches[i].fd == fd) return watches[i].handler;
+  return NULL;
+}
+
+
+bool reactor_run(void)
+{
+  struct epoll_event evs[MAX_WATCHES];
+
+  while (!stopped)
+  {
+    const int n = epoll_wait(epfd, evs, MAX_WATCHES, -1);
+    if (unlikely(n == -1))
+    {
+      if (errno == EINTR) continue;
+      log_perr(LOG_ERR, "Error waiting for events", errno);
+      return false;
+    }
+
+    runclock = boottime() - epoch;
+
+    for (int i=0; i<n && !stopped; ++i)
+    {
+      const fd_handler handler = find_handler(evs[i].data.fd);
+      if (likely(handler != NULL)) handler(evs[i].data.fd, evs[i].events);
+    }
+  }
+  return true;
+}
+
+
+void reactor_stop(void)
+{
+  stopped = true;
+}
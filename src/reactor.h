@@ -0,0 +1,58 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_REACTOR_H
+#define SWAPSPACE_REACTOR_H
+
+#include <stdint.h>
+
+#include "main.h"
+
+/* The daemon's central loop.  Everything it reacts to--the policy tick,
+ * signals, memory pressure notifications--arrives as a file descriptor becoming
+ * ready, and is dispatched to a handler from one epoll loop.
+ */
+
+/// Handler for a file descriptor that has become ready
+/**
+ * @param fd The file descriptor, as registered with reactor_watch()
+ * @param events The epoll events that occurred on fd
+ */
+typedef void (*fd_handler)(int fd, uint32_t events);
+
+/// Start the clock.  From here on, runclock counts seconds of real time.
+void reactor_init(void);
+
+/// Set up the event loop.  Call after any fork().
+bool reactor_start(void);
+
+/// Dispatch handler whenever any of events occurs on fd
+bool reactor_watch(int fd, uint32_t events, fd_handler handler);
+
+/// Stop watching fd (but do not close it)
+void reactor_unwatch(int fd);
+
+/// Call handler every msecs milliseconds
+bool reactor_tick(int msecs, void (*handler)(void));
+
+/// Run the event loop until reactor_stop() is called
+bool reactor_run(void);
+
+/// Make reactor_run() return once the current event has been handled
+void reactor_stop(void);
+
+#endif
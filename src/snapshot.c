@@ -0,0 +1,79 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <string.h>
+
+#include "leak.h"
+#include "memory.h"
+#include "snapshot.h"
+#include "support.h"
+#include "swaps.h"
+#include "trend.h"
+
+
+/// Shortest interval between scans, in milliseconds
+/** While free space falls fast we may sample every few dozen milliseconds.
+ * Those samples are about free space; leaking processes, cgroups, NUMA nodes
+ * and zone watermarks don't change that fast, and take far longer to look at.
+ */
+#define SCAN_INTERVAL 1000
+
+/// When we last scanned, if ever
+static struct timespec last_scan;
+static bool scanned = false;
+
+/// The latest snapshot, for dumps
+static struct snapshot latest;
+static bool have_latest = false;
+
+
+bool take_snapshot(struct snapshot *snap, bool thorough)
+{
+  memset(snap, 0, sizeof(*snap));
+  clock_gettime(CLOCK_MONOTONIC, &snap->taken);
+  snap->scan = thorough || !scanned ||
+    (snap->taken.tv_sec - last_scan.tv_sec)*1000LL +
+    (snap->taken.tv_nsec - last_scan.tv_nsec)/1000000 >= SCAN_INTERVAL;
+  if (snap->scan)
+  {
+    last_scan = snap->taken;
+    scanned = true;
+  }
+
+  if (unlikely(!sample_memory(snap, thorough))) return false;
+  if (snap->scan) leak_scan(snap);
+  trend_sample(&snap->taken, snap->space_total, snap->space_free, &snap->trend);
+  memory_control(snap);
+  snap->target = memory_target(snap);
+
+  // Swaps and filesystem only matter if we may allocate or free swap space.
+  if (thorough || snap->resized || snap->target)
+    snap->swaps = read_proc_swaps() &&
+      swapfs_stat(&snap->swapfs_free, &snap->swapfs_size);
+
+  latest = *snap;
+  have_latest = true;
+  return true;
+}
+
+
+const struct snapshot *latest_snapshot(void)
+{
+  return have_latest ? &latest : NULL;
+}
@@ -0,0 +1,105 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_SNAPSHOT_H
+#define SWAPSPACE_SNAPSHOT_H
+
+#include <time.h>
+
+#include "main.h"
+#include "memory.h"
+#include "pid.h"
+#include "thrash.h"
+#include "trend.h"
+
+/// Everything we know about the system, as of one moment
+/** Each iteration samples the system once, and bases all of its decisions on
+ * that one consistent view.  Nothing should re-read /proc/meminfo, /proc/swaps,
+ * or the swap directory's filesystem status halfway through.
+ */
+struct snapshot
+{
+  /// When the snapshot was taken (CLOCK_MONOTONIC)
+  struct timespec taken;
+
+  /// Were processes, cgroups, NUMA nodes and zone watermarks looked at?
+  /** These scans are too slow to repeat at the fastest pace.  If not set, the
+   * snapshot carries the cgroup and NUMA demand last seen.
+   */
+  bool scan;
+
+  /// Was /proc/meminfo read?
+  /** If not, a quick look showed we're comfortably between both freelimits and
+   * mem is all zeroes.
+   */
+  bool meminfo;
+  /// Memory statistics
+  struct memstate mem;
+
+  /// Total space, memory plus swap
+  /** Unlike mem, this is always set; if meminfo was not read, it's a quick
+   * estimate.
+   */
+  memsize_t space_total;
+  /// Free space, as estimated by the memory module (quick estimate if !meminfo)
+  memsize_t space_free;
+
+  /// Swap space wanted by memory cgroups under pressure, if we watch them
+  memsize_t cgroup_demand;
+  /// Swap space wanted by NUMA nodes under pressure, if we watch them
+  memsize_t numa_demand;
+  /// Change in physical memory size, if large enough to act on; else zero
+  /** Memory may be hotplugged, or taken away and given back by a balloon driver
+   * in a virtual machine.
+   */
+  memsize_t resized;
+
+  /// Where memory usage seems to be heading, including this snapshot
+  struct forecast trend;
+  /// PID controller's output, if that policy is in use
+  struct pid_terms control;
+  /// Paging rates, as of the last time /proc/vmstat was sampled
+  struct vm_rates rates;
+  /// Swap to add (or if negative, remove), as memory_target() recommends
+  memsize_t target;
+
+  /// Were /proc/swaps and the swap directory's filesystem sampled?
+  /** We only look at these if we may need to allocate or free swap space.  Our
+   * list of swapfiles is brought up to date as part of the snapshot.
+   */
+  bool swaps;
+  /// Space available on swap directory's filesystem
+  memsize_t swapfs_free;
+  /// Total size of swap directory's filesystem
+  memsize_t swapfs_size;
+};
+
+/// Sample the system.  Clobbers localbuf.
+/**
+ * @param snap Receives the snapshot
+ * @param thorough Gather all information, even if there's no immediate need
+ * @return Success
+ */
+bool take_snapshot(struct snapshot *snap, bool thorough);
+
+/// The snapshot we last based decisions on, or NULL if there is none yet
+/** Taking a snapshot feeds the trend, the PID controller and more, so a status
+ * dump shows this one rather than taking its own.
+ */
+const struct snapshot *latest_snapshot(void);
+
+#endif
@@ -23,10 +23,16 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include "env.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
+#include <sys/param.h>
+
+#include "leak.h"
 #include "log.h"
 #include "main.h"
 #include "memory.h"
+#include "opts.h"
+#include "snapshot.h"
 #include "state.h"
 #include "support.h"
 #include "swaps.h"
@@ -34,34 +40,140 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 /* The allocation/deallocation algorithm is driven by a state machine.
  */
 
-/* TODO: Adaptive cooldown_time?
- * Extend cooldown time if a swapfile is allocated shortly after deallocation in
- * "overfed" state (say, within another timeout period), or if one is
- * deallocated shortly (say, at most two timeout periods) after having been
- * allocated.
- * Reduce cooldown time if "hungry" and/or "overfed" states consistently timeout
- * too soon (say, X times in the first half of the timeout period but never in
- * the second)
+/// Configured cooldown time (in seconds) before returning to "steady state"
+static time_t cooldown_time = 600;
+/// Configuration items: bounds for the cooldown time as it adapts (seconds)
+/** The configured cooldown time is always within bounds, even if it's outside
+ * these.  Setting both to the cooldown time stops it from adapting.
  */
+static time_t min_cooldown = 150, max_cooldown = 2400;
 
-/// Minimum cooldown time before returning to "steady state" allocation policy
-static time_t cooldown_time = 600;
+/// Cooldown time as adapted to how the system behaves
+static time_t cooldown = 600;
 
-/// Countdown timer for return to "steady state"
+/// Deadline (in terms of runclock) for leaving the current state, or -1
 static time_t timer = 0;
 
-static inline void timer_reset(void) { timer = cooldown_time; }
-static inline void timer_tick(void) { --timer; }
-static inline bool timer_timeout(void) { return timer <= 0; }
+static void timer_reset(void);
+static inline time_t timer_left(void) { return timer - runclock; }
+static inline bool timer_timeout(void)
+{
+  return timer >= 0 && timer_left() <= 0;
+}
 
 #ifndef NO_CONFIG
 char *set_cooldown(long long duration)
 {
-  cooldown_time = (time_t)duration;
+  cooldown_time = cooldown = (time_t)duration;
   timer_reset();
   return NULL;
 }
+char *set_min_cooldown(long long duration)
+{
+  min_cooldown = (time_t)duration;
+  return NULL;
+}
+char *set_max_cooldown(long long duration)
+{
+  max_cooldown = (time_t)duration;
+  return NULL;
+}
+
+bool state_check_config(void)
+{
+  CHECK_CONFIG_ERR(min_cooldown > max_cooldown);
+  return true;
+}
+#endif
+
+
+/* Creating a swapfile and deleting it again soon after is costly: the file may
+ * be gigabytes of disk writes.  So the cooldown time adapts.  It's lengthened
+ * if we allocate shortly after freeing swap, or free unusually soon after
+ * allocating; either way we didn't wait long enough.  It's shortened if, time
+ * after time, the "hungry" and "overfed" states see no activity in the second
+ * half of their timer periods; that half was wasted waiting.
+ */
+
+/// Consecutive timer periods with a quiet second half before we shorten
+#define QUIET_PERIODS 4
+
+/// runclock at last allocation or release of swap, or -1 if none lately
+static time_t last_alloc = -1, last_release = -1;
+/// Consecutive timer periods whose second half saw no activity
+static int quiet_periods = 0;
+/// Why the cooldown time was last changed
+static char cooldown_reason[80] = "as configured";
+
+static time_t cooldown_lo(void) { return MIN(min_cooldown, cooldown_time); }
+static time_t cooldown_hi(void) { return MAX(max_cooldown, cooldown_time); }
+
+/// Set new cooldown time, within bounds
+/**
+ * @param secs New cooldown time
+ * @param why Format string for our reasons; may refer to n as "%ld"
+ * @param n Number to include in our reasons
+ */
+static void adapt_cooldown(time_t secs, const char why[], long n)
+{
+  if (secs < cooldown_lo()) secs = cooldown_lo();
+  if (secs > cooldown_hi()) secs = cooldown_hi();
+  quiet_periods = 0;
+  if (secs == cooldown) return;
+
+  snprintf(cooldown_reason, sizeof(cooldown_reason), why, n);
+#ifndef NO_CONFIG
+  if (verbose)
+    logm(LOG_DEBUG,
+	"Cooldown %ld s -> %ld s: %s",
+	(long)cooldown,
+	(long)secs,
+	cooldown_reason);
 #endif
+  cooldown = secs;
+}
+
+/// We've allocated a swapfile.  Had we freed one too recently?
+static void note_alloc(void)
+{
+  if (last_release >= 0 && runclock - last_release <= cooldown)
+    adapt_cooldown(cooldown*3/2,
+	"lengthened; allocated %ld s after freeing",
+	(long)(runclock - last_release));
+  last_alloc = runclock;
+}
+
+/// We've freed a swapfile.  Had we allocated one too recently?
+static void note_release(void)
+{
+  /* Normally we can't free until the "hungry" and then "overfed" timers have
+   * run out.  Freeing sooner means we went into "diet" state having allocated
+   * more than we needed.
+   */
+  if (last_alloc >= 0 && runclock - last_alloc < 2*cooldown)
+    adapt_cooldown(cooldown*3/2,
+	"lengthened; freed %ld s after allocating",
+	(long)(runclock - last_alloc));
+  last_release = runclock;
+}
+
+/// Leaving a state after age seconds in it.  Was the timer period too long?
+static void note_period(time_t age)
+{
+  // Cut short by activity in the first half; that says nothing about the rest.
+  if (age <= cooldown/2) return;
+  if (age < cooldown)
+  {
+    // Something happened in the second half.  The timer is about right.
+    quiet_periods = 0;
+  }
+  else if (++quiet_periods >= QUIET_PERIODS)
+  {
+    adapt_cooldown(cooldown*3/4,
+	"shortened; %ld timer periods without late activity",
+	(long)quiet_periods);
+  }
+}
 
 
 /// State machine describing transitions in allocation policy
@@ -70,31 +182,319 @@ enum State
   st_diet,	// Ran into disk limit; don't allocate
   st_hungry,	// Want more, or at least don't consider deallocation
   st_steady,	// Entirely neutral
-  st_overfed	// Waiting to see if it's okay to deallocate
+  st_overfed,	// Waiting to see if it's okay to deallocate
+  st_emergency,	// Critically short of memory; allocate without waiting
+  st_draining,	// Waiting for a swapfile to be disabled
+  num_states,
+  st_stay	// Not a state: a transition's action may return it to stay put
 };
 
-static const char *Statenames[] =
+static time_t cooldown_timeout(void) { return cooldown; }
+
+static void enter_emergency(void)
+{
+  logm(LOG_NOTICE, "Free memory critically low; allocating without delay");
+}
+
+/// Per-state behaviour; the transitions out of each state are further down
+struct state_info
+{
+  const char *name;
+  /// How long we may stay in this state before timing out, or NULL if forever
+  time_t (*timeout)(void);
+  /// Called on entering the state, or NULL
+  void (*enter)(void);
+  /// Called on leaving the state after age seconds in it, or NULL
+  void (*leave)(time_t age);
+};
+
+static const struct state_info states[num_states] =
 {
-  "diet",
-  "hungry",
-  "steady",
-  "overfed"
+  [st_diet] =		{ "diet",	cooldown_timeout, NULL, NULL },
+  [st_hungry] =		{ "hungry",	cooldown_timeout, NULL, note_period },
+  [st_steady] =		{ "steady",	cooldown_timeout, NULL, NULL },
+  [st_overfed] =	{ "overfed",	cooldown_timeout, NULL, note_period },
+  [st_emergency] =	{ "emergency",	NULL, enter_emergency, NULL },
+  [st_draining] =	{ "draining",	NULL, NULL, NULL },
 };
 
 
 static enum State the_state = st_hungry;
+/// runclock when we entered the_state
+static time_t state_entered = 0;
 static bool need_diet = false;
 static memsize_t oldreqbytes = 0;
 
 void request_diet(void) { need_diet = true; }
 
+bool state_steady(void) { return the_state == st_steady; }
+
+static void timer_reset(void)
+{
+  const struct state_info *const s = &states[the_state];
+  timer = s->timeout ? runclock + s->timeout() : -1;
+}
+
 static void state_to(enum State s)
 {
 #ifndef NO_CONFIG
-  if (verbose) logm(LOG_DEBUG,"%s -> %s",Statenames[the_state],Statenames[s]);
+  if (verbose)
+    logm(LOG_DEBUG, "%s -> %s", states[the_state].name, states[s].name);
 #endif
+  if (states[the_state].leave) states[the_state].leave(runclock-state_entered);
   the_state = s;
+  state_entered = runclock;
   timer_reset();
+  if (states[s].enter) states[s].enter();
+}
+
+/// Go to state s; or if a swapfile is still draining, wait for that first
+static void state_to_or_drain(enum State s)
+{
+  if (!drain_in_progress()) state_to(s);
+  else if (the_state != st_draining) state_to(st_draining);
+}
+
+
+/// Free up to maxsize bytes of swap space
+static void release(const struct snapshot *snap, memsize_t maxsize)
+{
+  if (free_swapfile(snap, maxsize)) note_release();
+  memory_forget();
+}
+
+
+/// Allocate swapfile of reqbytes, unless it would only go to waste or to a leak
+static bool allocate(const struct snapshot *snap, memsize_t reqbytes)
+{
+  if (unlikely(memory_growth_futile(snap)))
+  {
+#ifndef NO_CONFIG
+    if (verbose) logm(LOG_DEBUG, "Thrashing; not allocating more swap");
+#endif
+    return false;
+  }
+  if (unlikely(leak_capped()))
+  {
+#ifndef NO_CONFIG
+    if (verbose) logm(LOG_DEBUG, "Process leaking; not allocating more swap");
+#endif
+    return false;
+  }
+  if (unlikely(!alloc_swapfile(snap, reqbytes))) return false;
+  note_alloc();
+  memory_forget();
+  return true;
+}
+
+
+/// What we know during one iteration of the state machine
+struct tick
+{
+  const struct snapshot *snap;
+  /// Recent targets
+  struct target_stats ts;
+  /// Is free memory critically low?
+  bool critical;
+  /// Is a swapfile being drained?
+  bool draining;
+};
+
+
+/* Transition guards.  Decisions are based on the recent history of targets,
+ * not just the current one: we allocate only if swap was short throughout the
+ * allocation window, and consider swap to be in excess only if it was so
+ * throughout the deallocation window.  Only in an emergency do we act on the
+ * current target alone.  It's only an emergency if more swap would help, so
+ * there's always a way out even if free memory stays critically low.
+ */
+static bool critical(const struct tick *t)
+{
+  return t->critical && t->ts.now > 0;
+}
+static bool relieved(const struct tick *t) { return !critical(t); }
+static bool short_always(const struct tick *t) { return t->ts.least > 0; }
+static bool excess(const struct tick *t) { return t->ts.most < 0; }
+static bool no_excess(const struct tick *t) { return t->ts.most >= 0; }
+static bool drained(const struct tick *t) { return !t->draining; }
+static bool thrashing(const struct tick *t) { return t->snap->rates.thrashing; }
+static bool timeout(const struct tick *t) { return timer_timeout(); }
+
+
+/* Transition actions.  Each returns the state to go to, normally the one the
+ * transition leads to, or st_stay to remain in the current state.
+ */
+
+static enum State go(const struct tick *t, enum State to) { return to; }
+
+/// Allocate what we need right now, if anything; go ahead regardless
+static enum State allocate_now(const struct tick *t, enum State to)
+{
+  if (t->ts.now > 0) allocate(t->snap, t->ts.now);
+  return to;
+}
+
+/// Allocate; if that works, go ahead.  If it fails, alloc_swapfile() will
+/// have requested "diet" if that's what's needed.
+static enum State allocate_or_stay(const struct tick *t, enum State to)
+{
+  return allocate(t->snap, t->ts.now) ? to : st_stay;
+}
+
+/// Free excess swap space
+static enum State trim(const struct tick *t, enum State to)
+{
+  if (t->ts.most < 0) release(t->snap, -t->ts.most);
+  return to;
+}
+
+/// Go ahead, unless a swapfile is still draining; then wait for that first
+static enum State go_or_drain(const struct tick *t, enum State to)
+{
+  return t->draining ? st_draining : to;
+}
+
+/// Free excess swap space; if that takes a while, wait for it in "draining"
+static enum State trim_or_drain(const struct tick *t, enum State to)
+{
+  trim(t, to);
+  return drain_in_progress() ? st_draining : to;
+}
+
+
+/// A transition: in state from, if guard holds, perform action and go to to
+struct transition
+{
+  enum State from;
+  bool (*guard)(const struct tick *t);
+  const char *guard_name;
+  enum State (*action)(const struct tick *t, enum State to);
+  const char *action_name;
+  enum State to;
+};
+
+#define TRANSITION(from, guard, action, to) \
+  { from, guard, #guard, action, #action, to }
+
+/// The state machine.  In each state, the first transition whose guard holds is
+/// taken.
+static const struct transition transitions[] =
+{
+  /* Once free memory is critically low, waiting for the allocation window to
+   * confirm it is too risky.  Allocate straight away, and keep allocating as
+   * long as we're short; the "diet" state is the only one that prevents this.
+   * Once out of danger, we're "hungry" for the cooldown time as if we had just
+   * allocated the normal way, or back to "draining" if that's where we were.
+   */
+  TRANSITION(st_hungry,		critical,	allocate_now,	st_emergency),
+  TRANSITION(st_steady,		critical,	allocate_now,	st_emergency),
+  TRANSITION(st_overfed,	critical,	allocate_now,	st_emergency),
+  TRANSITION(st_draining,	critical,	allocate_now,	st_emergency),
+  TRANSITION(st_emergency,	relieved,	go_or_drain,	st_hungry),
+  TRANSITION(st_emergency,	critical,	allocate_now,	st_stay),
+
+  /* In any state except "diet," where allocation is inhibited, a shortage of
+   * memory means we forget what state we're in and jump straight to "hungry"
+   * mode, allocating a new swapfile along the way.  If the allocation fails,
+   * we bail out into "diet" mode next time, on alloc_swapfile()'s request.
+   * While a swapfile drains, we allocate but keep waiting for the drain.
+   */
+  TRANSITION(st_hungry,		short_always,	allocate_or_stay, st_hungry),
+  TRANSITION(st_steady,		short_always,	allocate_or_stay, st_hungry),
+  TRANSITION(st_overfed,	short_always,	allocate_or_stay, st_hungry),
+  TRANSITION(st_draining,	short_always,	allocate_or_stay, st_stay),
+
+  /* The "diet," "hungry" and "overfed" states time out eventually, leading
+   * back to "steady."
+   */
+  TRANSITION(st_diet,		timeout,	go,		st_steady),
+  TRANSITION(st_hungry,		timeout,	go,		st_steady),
+  TRANSITION(st_steady,		timeout,	go,		st_steady),
+
+  /* Freeing swap while the system thrashes means reading everything in the
+   * swapfile back into memory that is already overcommitted.  Hold off until
+   * the storm is over, and then wait out the full cooldown time again.
+   */
+  TRANSITION(st_diet,		thrashing,	go,		st_stay),
+  TRANSITION(st_steady,		thrashing,	go,		st_stay),
+  TRANSITION(st_overfed,	thrashing,	go,		st_steady),
+
+  /* Timing out of "overfed" is where we normally deallocate; if the swapfile
+   * we're freeing is in use, we wait for it to drain.
+   */
+  TRANSITION(st_overfed,	timeout,	trim_or_drain,	st_steady),
+
+  /* If we overallocated and now find ourselves with more swap space than we
+   * think we need, deallocate it right away.  Don't leave "diet" state just yet
+   * in that case, however, or we may invite thrashing.
+   */
+  TRANSITION(st_diet,		excess,		trim,		st_stay),
+
+  /* If we have more swap space than we need, go to "overfed" state which may
+   * eventually lead to deallocation.  If we find that we no longer have more
+   * than we need, we default back to steady state.
+   */
+  TRANSITION(st_steady,		excess,		go,		st_overfed),
+  TRANSITION(st_overfed,	no_excess,	go,		st_steady),
+
+  TRANSITION(st_draining,	drained,	go,		st_steady),
+};
+
+#define NUM_TRANSITIONS (sizeof(transitions)/sizeof(*transitions))
+
+
+/// Take the first transition out of the current state whose guard holds
+static void run_transitions(const struct tick *t)
+{
+  for (size_t i = 0; i < NUM_TRANSITIONS; ++i)
+  {
+    const struct transition *const tr = &transitions[i];
+    if (tr->from != the_state || !tr->guard(t)) continue;
+#ifndef NO_CONFIG
+    if (verbose)
+      logm(LOG_DEBUG, "%s: %s", states[the_state].name, tr->guard_name);
+#endif
+    const enum State next = tr->action(t, tr->to);
+    if (next != st_stay) state_to(next);
+    return;
+  }
+}
+
+
+/// Physical memory has grown or shrunk; reconsider swap space right away
+/** Whatever we learned about our targets was relative to the old memory size,
+ * so forget it.  If memory shrank and we're now short on swap, allocate; if it
+ * grew and we have swap to spare, free it.  Either way there's no waiting for
+ * the timer: a resize is not a passing fluctuation.  But a balloon driver may
+ * well change its mind, so we don't act against the direction of the change.
+ */
+static void handle_resize(const struct snapshot *snap)
+{
+  logm(LOG_NOTICE,
+      "Memory size %s by %lld bytes",
+      (snap->resized > 0) ? "grew" : "shrank",
+      llabs(snap->resized));
+  memory_forget();
+  // Earlier allocations and releases were for another memory size; they don't
+  // say anything about our cooldown time.
+  last_alloc = last_release = -1;
+
+  const memsize_t reqbytes = snap->target;
+#ifndef NO_CONFIG
+  if (verbose) logm(LOG_DEBUG, "Required bytes after resize: %lld", reqbytes);
+#endif
+  if (snap->resized < 0 && reqbytes > 0)
+  {
+    if (likely(the_state != st_diet) &&
+	allocate(snap, reqbytes) &&
+	the_state != st_emergency)
+      state_to_or_drain(st_hungry);
+  }
+  else if (snap->resized > 0 && reqbytes < 0 && !snap->rates.thrashing)
+  {
+    release(snap, -reqbytes);
+    if (the_state != st_diet) state_to_or_drain(st_steady);
+  }
 }
 
 
@@ -107,74 +507,90 @@ void handle_requirements(void)
     return;
   }
 
-  const memsize_t reqbytes = memory_target();
+  /* Sample the system once, and base all of this iteration's decisions on that
+   * one consistent picture.
+   */
+  struct snapshot snap;
+  if (unlikely(!take_snapshot(&snap, false))) return;
+  if (unlikely(snap.resized))
+  {
+    handle_resize(&snap);
+    return;
+  }
+
+  struct tick t;
+  t.snap = &snap;
+  memory_targets(&snap, &t.ts);
+  t.critical = memory_critical(&snap);
+  t.draining = drain_in_progress();
+  const memsize_t reqbytes = t.ts.now;
 #ifndef NO_CONFIG
   if (verbose && reqbytes != oldreqbytes)
-	  logm(LOG_DEBUG,"Required Bytes: %d", reqbytes);
+	  logm(LOG_DEBUG,"Required Bytes: %lld", reqbytes);
 #endif
-  timer_tick();
 
-  if (unlikely(reqbytes > 0) && likely(the_state != st_diet))
-  {
-    /* In any state except "diet," where allocation is inhibited, a shortage of
-     * memory means we forget what state we're in and jump straight to "hungry"
-     * mode, allocating a new swapfile along the way.  If the allocation fails,
-     * we bail out into "diet" mode next time, on alloc_swapfile()'s request.
-     */
-    if (likely(alloc_swapfile(reqbytes))) state_to(st_hungry);
-  }
-  else if (unlikely(timer_timeout()))
-  {
-    /* All states except "steady" are designed to time out eventually; in every
-     * case that leads back to "steady" so we can make it a general rule that
-     * timeout leads to "steady."
-     * The only other action that accompanies timeout is when timing out of the
-     * "overfed" state, which is where we normally deallocate.
-     */
+  run_transitions(&t);
+  oldreqbytes = reqbytes;
+}
+
+
+void handle_pressure(void)
+{
+  /* The kernel tells us tasks are stalling on memory.  Don't wait for the next
+   * tick; if we need more swap, allocate it now.  This does not count as a tick
+   * of the timer, and never deallocates.
+   */
+  if (unlikely(the_state == st_diet)) return;
+
+  // Whatever we thought we knew about memory, it's changed.  Take a full look.
+  struct snapshot snap;
+  if (unlikely(!take_snapshot(&snap, true))) return;
+
+  const memsize_t reqbytes = snap.target;
 #ifndef NO_CONFIG
-    if (verbose) logm(LOG_DEBUG,"Timeout");
+  if (verbose) logm(LOG_DEBUG, "Memory pressure; required bytes: %lld",reqbytes);
 #endif
-    if (unlikely(the_state == st_overfed)) free_swapfile(-reqbytes);
-    state_to(st_steady);
-  }
-  else switch (the_state)
-  {
-  case st_diet:
-    /* If we overallocated and now find ourselves with more swap space than we
-     * think we need, deallocate it right away.  Don't leave "diet" state just
-     * yet in that case, however, or we may invite thrashing.
-     */
-    if (unlikely(reqbytes < 0)) free_swapfile(-reqbytes);
-    break;
-  case st_hungry:
-    /* The "hungry" state can either time out, or allocate more swap space and
-     * loop back to itself, resetting the timer (or if allocation fails, bail
-     * out to "diet").  In other words, all actions for this state have been
-     * handled by the general cases above.
-     */
-    break;
-  case st_steady:
-    /* If we have more swap space than we need, go to "overfed" state which may
-     * eventually lead to deallocation.
-     */
-    if (unlikely(reqbytes < 0)) state_to(st_overfed);
-    break;
-  case st_overfed:
-    /* There are two ways out of "overfed" state: either we find that we no
-     * longer have more memory than we need, in which case we default back to
-     * steady state; or we time out as per the general case described above,
-     * having had excess swap space for an entire timer period and therefore
-     * deallocating swap space.
-     */
-    if (unlikely(reqbytes >= 0)) state_to(st_steady);
-    break;
-  }
-  oldreqbytes = reqbytes;
+  // An emergency ends only when free memory is no longer critically low, and a
+  // drain only when the swapfile is off.
+  if (reqbytes > 0 && allocate(&snap, reqbytes) && the_state != st_emergency)
+    state_to_or_drain(st_hungry);
+}
+
+
+void handle_hotplug(void)
+{
+  /* A hotplug event is only a hint; the snapshot shows whether the memory size
+   * changed enough to matter.  If so, we act on it now rather than at the next
+   * tick.
+   */
+  struct snapshot snap;
+  if (unlikely(!take_snapshot(&snap, true))) return;
+  if (snap.resized) handle_resize(&snap);
 }
 
 
 void dump_state(void)
 {
-  logm(LOG_INFO, "state: %s", Statenames[the_state]);
-  if (timer > 0) logm(LOG_INFO, "timer: %ld", (long)timer);
+  logm(LOG_INFO,
+      "state: %s for %ld s",
+      states[the_state].name,
+      (long)(runclock - state_entered));
+  if (timer_left() > 0) logm(LOG_INFO, "timer: %ld", (long)timer_left());
+  logm(LOG_INFO,
+      "cooldown: %ld s, within %ld..%ld; %s",
+      (long)cooldown,
+      (long)cooldown_lo(),
+      (long)cooldown_hi(),
+      cooldown_reason);
+  logm(LOG_INFO, "transitions:");
+  for (size_t i = 0; i < NUM_TRANSITIONS; ++i)
+  {
+    const struct transition *const tr = &transitions[i];
+    logm(LOG_INFO,
+	"  %-9s  if %-12s  do %-16s  -> %s",
+	states[tr->from].name,
+	tr->guard_name,
+	tr->action_name,
+	(tr->to == st_stay) ? "(stay)" : states[tr->to].name);
+  }
 }
@@ -25,14 +25,27 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 /// Perform one iteration of the allocation algorithm.  Clobbers localbuf.
 void handle_requirements(void);
 
+/// React to memory pressure reported by the kernel.  Clobbers localbuf.
+void handle_pressure(void);
+
+/// React to memory being hotplugged or unplugged.  Clobbers localbuf.
+void handle_hotplug(void);
+
 /// Log state information.  Clubbers localbuf.
 void dump_state(void);
 
+/// Are we in "steady" state, i.e. not allocating or deallocating?
+bool state_steady(void);
+
 /// Request a transition to "diet" state
 void request_diet(void);
 
 #ifndef NO_CONFIG
 char *set_cooldown(long long duration);
+char *set_min_cooldown(long long duration);
+char *set_max_cooldown(long long duration);
+
+bool state_check_config(void);
 #endif
 
 #endif
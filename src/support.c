@@ -22,13 +22,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include "env.h"
 
 #include <errno.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
 
 #include "log.h"
 #include "main.h"
 #include "support.h"
 
+extern char **environ;
+
 #ifndef HAVE_SWAPON
 /// Replacement function for system function.  Clobbers localbuf.
 int swapon(const char path[], int flags)
@@ -58,7 +64,27 @@ int runcommandformat(const char format[], const char cmd[], const char arg[])
   {
     logm(LOG_DEBUG, "Running: (%s)", localbuf);
   }
-  return system(localbuf);
+
+  /* Like system(), but the command gets the signal mask we started with rather
+   * than the one we run with.
+   */
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &original_sigmask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+  char *const argv[] = { "sh", "-c", localbuf, NULL };
+  pid_t pid;
+  const int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  if (unlikely(err))
+  {
+    errno = err;
+    return -1;
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) == -1) if (errno != EINTR) return -1;
+  return status;
 }
 
 int runcommand(const char cmd[], const char arg[])
@@ -37,8 +37,9 @@ int swapoff(const char path[]);
 #endif
 
 /// Run given shell command with given argument.  Clobbers localbuf.
-/** A convenient front-end for system(), this composes a command line consisting
- * of a command followed by a single argument (which will be quoted).
+/** A convenient front-end for sh(1), this composes a command line consisting
+ * of a command followed by a single argument (which will be quoted).  Unlike
+ * with system(), the command runs with the signal mask we were started with.
  * @return -1 on failure to execute (check errno), or the command's return
  * value.
  */
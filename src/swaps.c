@@ -31,6 +31,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include <sys/param.h>
@@ -38,13 +39,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include <sys/statvfs.h>
 #include <sys/swap.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <sys/ioctl.h>
 #include <sys/vfs.h>
 #include <linux/fs.h>
 #include <linux/magic.h>
 
+#include "cgroup.h"
 #include "log.h"
+#include "main.h"
 #include "opts.h"
+#include "pace.h"
+#include "policy.h"
 #include "state.h"
 #include "support.h"
 #include "swaps.h"
@@ -71,6 +77,10 @@ static memsize_t min_swapsize = 4*MEGA;
  * limits.
  */
 static memsize_t max_swapsize = 2*TERA;
+/// Configuration item: make each swapfile in a burst n% of the one before
+/** Zero means off: each swapfile is as large as requested, and no larger.
+ */
+static int chunk_growth = 0;
 
 /// Truncate n to a multiple of memory page size
 static memsize_t trunc_to_page(memsize_t n)
@@ -100,6 +110,11 @@ char *set_max_swapsize(long long size)
   max_swapsize = trunc_to_page(size);
   return NULL;
 }
+char *set_chunk_growth(long long pct)
+{
+  chunk_growth = (int)pct;
+  return NULL;
+}
 
 bool paranoid = false;
 char *set_paranoid(long long dummy)
@@ -115,6 +130,7 @@ bool swaps_check_config(void)
 {
   CHECK_CONFIG_ERR(min_swapsize > max_swapsize);
   CHECK_CONFIG_ERR(min_swapsize < 10*getpagesize());
+  CHECK_CONFIG_ERR(chunk_growth && chunk_growth < 100);
 
   if (swappath[0] != '/')
   {
@@ -290,16 +306,94 @@ static struct Swapfile swapfiles[MAX_SWAPFILES+1];
 /// Have we been able to verify that /proc/swaps is in the expected format?
 static bool proc_swaps_read_ok = false;
 
+/// All active swap, ours or not, as of the last read of /proc/swaps
+static memsize_t all_swap = 0;
+
 /// Can we allocate swapfiles using posix_allocate on this filesystem?
 static bool pfalloc_ok = true;
 
+/// Assumed swapfile creation speed until we've measured it, in bytes per second
+/** Deliberately pessimistic: roughly what it takes to write out a file in full
+ * on a slow disk.
+ */
+#define ASSUMED_CREATION_RATE (32*MEGA)
+
+/// Measured swapfile creation speed, in bytes per second, or 0 if unknown
+static double creation_rate = 0;
+
+/* Each swapfile costs a file creation, mkswap and swapon, and takes one of only
+ * MAX_SWAPFILES slots.  When memory keeps running short for a while, creating
+ * just what each tick asks for makes for a string of small swapfiles.  So with
+ * chunk growth set, allocations that follow each other within BURST_WINDOW
+ * seconds form a burst, and each swapfile in a burst is chunk_growth percent
+ * the size of the one before.  What's more, the first swapfile of a burst is as
+ * large as a typical burst has been in total, so that one swapfile can cover a
+ * whole ramp.  If it did, the typical burst size creeps back down towards what
+ * was actually asked for.
+ *
+ * The sizing policy may call for chunk growth of its own ("exponential" does);
+ * a configured chunk_growth takes its place.  Either way, growth is applied
+ * here only, once, on top of what the policy asked for.
+ *
+ * None of this takes a swapfile beyond max_swapsize, nor (beyond what was asked
+ * for) past half the free space on the swap directory's filesystem.
+ */
+
+/// Allocations this close together (in seconds) form a burst
+#define BURST_WINDOW 600
+
+/// runclock at the last allocation in the current burst
+static time_t burst_last = 0;
+/// Swapfiles created in the current burst, or 0 if there is none
+static int burst_count = 0;
+/// Size of the current burst's latest swapfile
+static memsize_t burst_chunk = 0;
+/// Bytes allocated in the current burst
+static memsize_t burst_total = 0;
+/// Bytes requested for the current burst's first swapfile
+static memsize_t burst_request = 0;
+/// Learned size of a burst, in bytes; 0 until we've seen one
+static memsize_t typical_burst = 0;
+
+/// Chunk growth in percent, as configured or as the policy calls for, or 0
+static inline int growth(void)
+{
+  return chunk_growth ? chunk_growth : policy_chunk_growth();
+}
+
+
+/* Disabling a swapfile means reading everything in it back into memory, which
+ * for a well-used swapfile can take minutes.  We don't want to sit in swapoff()
+ * all that time, deaf to memory pressure, so if there's much to read back we
+ * leave the waiting to a child process.  One swapfile drains at a time.
+ */
+
+/// Swapfiles with at least this many bytes in use are drained in the background
+#define SLOW_SWAPOFF (16*MEGA)
+
+/// Swapfile being drained, or -1 if none
+static int draining_file = -1;
+/// Size of the swapfile being drained
+static memsize_t draining_size = 0;
+/// Child process disabling the swapfile being drained, or -1 if none
+static pid_t drain_pid = -1;
+/// runclock when the drain started
+static time_t drain_started = 0;
+
 /// Print status information to stdout
 void dump_stats(void)
 {
   logm(LOG_INFO, "clock: %lld", (long long)runclock);
 
+  const struct snapshot *const snap = latest_snapshot();
+
   dump_state();
-  dump_memory();
+  dump_pace();
+  if (snap) dump_memory(snap);
+  if (creation_rate > 0)
+    logm(LOG_INFO,
+	"swapfile creation: %lld bytes/s measured",
+	(long long)creation_rate);
 
   // Count active swapfiles.  Note that we don't remember this anywhere; it's
   // rarely needed (only when requested), it's not very costly to derive, and
@@ -307,6 +401,17 @@ void dump_stats(void)
   int activeswaps = 0;
   for (int i=0; i<MAX_SWAPFILES; ++i) if (swapfiles[i].size) ++activeswaps;
   logm(LOG_INFO, "swapfiles in use: %d", activeswaps);
+  if (growth())
+    logm(LOG_INFO,
+	"allocation burst: %d swapfiles, %lld bytes; typical burst %lld",
+	burst_count,
+	burst_total,
+	typical_burst);
+  if (drain_pid != -1)
+    logm(LOG_INFO,
+	"draining swapfile %d for %ld s",
+	draining_file,
+	(long)(runclock - drain_started));
   if (activeswaps)
   {
     logm(LOG_INFO,
@@ -357,26 +462,22 @@ static memsize_t fs_size(memsize_t n, memsize_t blocksize)
 }
 
 
-memsize_t swapfs_free(void)
+bool swapfs_stat(memsize_t *freespace, memsize_t *size)
 {
   struct statvfs fsinfo;
 
-  if (unlikely(!statvfs_wrapper(&fsinfo))) return 0;
+  if (unlikely(!statvfs_wrapper(&fsinfo)))
+  {
+    *freespace = *size = 0;
+    return false;
+  }
 
-  // Return free space available to non-root users rather than the space that is
+  // Report free space available to non-root users rather than the space that is
   // really free, so we leave some margin for the superuser to work in if the
   // disk fills up.
-  return fs_size(fsinfo.f_bavail, fsinfo.f_bsize);
-}
-
-
-memsize_t swapfs_size(void)
-{
-  struct statvfs fsinfo;
-
-  if (unlikely(!statvfs_wrapper(&fsinfo))) return 0;
-
-  return fs_size(fsinfo.f_blocks, fsinfo.f_bsize);
+  *freespace = fs_size(fsinfo.f_bavail, fsinfo.f_bsize);
+  *size = fs_size(fsinfo.f_blocks, fsinfo.f_bsize);
+  return true;
 }
 
 /// Turn an existing file into an active swap.  Clobbers localbuf.
@@ -669,6 +770,7 @@ static bool get_swapfile_status(FILE *fp, struct swapfile_info *result)
     // /proc/swaps appears to report sizes in 1 KB blocks
     result->size *= KILO;
     result->used *= KILO;
+    if (likely(x == 5)) all_swap += result->size;
 
     if (likely(strcmp(type, "file") == 0) &&
 	likely(strncmp(result->name, swappath, swappath_len) == 0) &&
@@ -738,6 +840,7 @@ bool read_proc_swaps(void)
   if (unlikely(!fp)) return false;
 
   for (int i=0; i<MAX_SWAPFILES; ++i) swapfiles[i].observed_in_wild = false;
+  all_swap = 0;
 
   struct swapfile_info inf;
   while (get_swapfile_status(fp, &inf));
@@ -749,10 +852,39 @@ bool read_proc_swaps(void)
     if (unlikely(swapfiles[i].size && !swapfiles[i].observed_in_wild))
       swapfiles[i].size = 0;
 
+  if (likely(result)) cgroup_rebalance(all_swap);
   return result;
 }
 
 
+/// Delete swapfile that has been disabled, and forget about it
+static void finish_retire(int file, memsize_t size)
+{
+  char namebuf[30];
+  snprintf(namebuf, sizeof(namebuf), "%d", file);
+
+#ifndef NO_CONFIG
+  int fd = -1;
+  if (paranoid)
+    fd = open(namebuf, O_WRONLY|O_LARGEFILE|O_NOFOLLOW);
+#endif
+
+  unlink(namebuf);
+
+#ifndef NO_CONFIG
+  if (fd != -1) {
+    write_data(fd, size, true);
+    close(fd);
+  }
+#endif
+
+  // If we've reread /proc/swaps since the swapoff(), this is zero already.
+  all_swap -= swapfiles[file].size;
+  swapfiles[file].size = 0;
+  cgroup_rebalance(all_swap);
+}
+
+
 /// Disable swapfile and delete it.  Clobbers localbuf.
 static bool retire_swapfile(int file)
 {
@@ -776,23 +908,93 @@ static bool retire_swapfile(int file)
 #endif
   if (unlikely(swapoff(namebuf) == -1)) return false;
 
+  finish_retire(file, swapfiles[file].size);
+  return true;
+}
+
+
+/// Start disabling swapfile in a child process
+/** Falls back to retire_swapfile() if we can't fork.
+ *
+ * Not vfork(): that would stop us until the swapoff() is done, which is what
+ * the child is for.  The child does not exec anything, so it has to restore
+ * the signal mask itself; otherwise the signals we block for our signalfd
+ * couldn't stop it.
+ */
+static bool drain_swapfile(int file)
+{
+  assert(file >= 0);
+  assert(file < MAX_SWAPFILES);
+  assert(drain_pid == -1);
+
+  char namebuf[30];
+  snprintf(namebuf, sizeof(namebuf), "%d", file);
+  const pid_t pid = fork();
+  if (pid == 0)
+  {
+    sigprocmask(SIG_SETMASK, &original_sigmask, NULL);
+    _exit((swapoff(namebuf) == -1) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+  if (unlikely(pid == -1))
+  {
+    log_perr(LOG_WARNING, "Could not fork to drain swapfile", errno);
+    return retire_swapfile(file);
+  }
+
 #ifndef NO_CONFIG
-  int fd = -1;
-  if (paranoid)
-    fd = open(namebuf, O_WRONLY|O_LARGEFILE|O_NOFOLLOW);
+  if (!quiet)
+    logm(LOG_NOTICE,
+	"Draining swapfile '%d' (%lld bytes in use)",
+	file,
+	swapfiles[file].used);
 #endif
+  draining_file = file;
+  draining_size = swapfiles[file].size;
+  drain_pid = pid;
+  drain_started = runclock;
+  return true;
+}
 
-  unlink(namebuf);
 
+/// Collect the drain's child process, if it's done (or if wait is set)
+/**
+ * @return Whether the drain is still running
+ */
+static bool reap_drain(bool wait)
+{
+  if (drain_pid == -1) return false;
+
+  int status = 0;
+  const pid_t pid = waitpid(drain_pid, &status, wait ? 0 : WNOHANG);
+  if (pid == 0) return true;
+
+  const int file = draining_file;
+  drain_pid = -1;
+  draining_file = -1;
+  if (likely(pid != -1) &&
+      likely(WIFEXITED(status)) &&
+      likely(WEXITSTATUS(status) == EXIT_SUCCESS))
+  {
 #ifndef NO_CONFIG
-  if (fd != -1) {
-    write_data(fd, swapfiles[file].size, true);
-    close(fd);
-  }
+    if (verbose)
+      logm(LOG_DEBUG,
+	  "Swapfile '%d' drained in %ld s",
+	  file,
+	  (long)(runclock - drain_started));
 #endif
+    finish_retire(file, draining_size);
+  }
+  else
+  {
+    logm(LOG_WARNING, "Could not disable swapfile '%d'", file);
+  }
+  return false;
+}
 
-  swapfiles[file].size = 0;
-  return true;
+
+bool drain_in_progress(void)
+{
+  return reap_drain(false);
 }
 
 
@@ -802,16 +1004,18 @@ static bool retirable(int file, memsize_t maxsize)
   assert(file >= 0);
   assert(file < MAX_SWAPFILES);
   // TODO: Include usage in calculations?  Like "free the most unused space"?
-  return swapfiles[file].size && swapfiles[file].size <= maxsize;
+  return swapfiles[file].size &&
+    swapfiles[file].size <= maxsize &&
+    file != draining_file;
 }
 
 
 /// Find a file to retire, or return MAX_SWAPFILES if none available
 /** Policy is to offer the largest swapfile that is not bigger than target.
+ * Relies on swapfiles[] being up to date with /proc/swaps.
  */
 static int find_retirable(memsize_t target)
 {
-  if (!read_proc_swaps()) return MAX_SWAPFILES;
   int best=MAX_SWAPFILES;
   assert(!swapfiles[best].size);
   for (int i=0; i<MAX_SWAPFILES; ++i)
@@ -825,6 +1029,9 @@ bool retire_all(void)
 {
   bool ok = true;
 
+  // Let any drain finish first; it's disabling one of our swapfiles already.
+  reap_drain(true);
+
   for (int i=0; i<MAX_SWAPFILES; ++i)
     if (swapfiles[i].size && !retire_swapfile(i)) ok = false;
 
@@ -832,29 +1039,115 @@ bool retire_all(void)
 }
 
 
+memsize_t swapfile_quantum(void)
+{
+  return min_swapsize;
+}
+
+
+double swapfile_creation_time(memsize_t size)
+{
+  if (creation_rate > 0) return size / creation_rate;
+  return size / (double)ASSUMED_CREATION_RATE;
+}
+
+/// Record how long it took to create a swapfile of given size
+static void note_creation(memsize_t size, const struct timespec *start)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double secs =
+    (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+  if (unlikely(secs <= 0)) return;
+
+  // Blend in with what we saw before: a file that happened to be written while
+  // the disk was busy shouldn't make us expect every later one to be slow.
+  const double current = size / secs;
+  creation_rate = (creation_rate > 0) ? (creation_rate + current) / 2 : current;
+}
+
+
+/// Is swapfile slot taken?  A draining swapfile may already be gone from
+/// /proc/swaps, but its file still exists.
+static inline bool slot_taken(int i)
+{
+  return swapfiles[i].size || i == draining_file;
+}
+
+/// If the current burst is over, learn from it
+static void close_burst(void)
+{
+  if (!burst_count || runclock - burst_last <= BURST_WINDOW) return;
+
+  if (burst_count > 1)
+    // One swapfile wasn't enough.  Next time, aim for all of it.
+    typical_burst = burst_total;
+  else
+    typical_burst = (3*typical_burst + burst_request) / 4;
+#ifndef NO_CONFIG
+  if (verbose)
+    logm(LOG_DEBUG,
+	"Allocation burst over: %d swapfiles, %lld bytes; typical %lld",
+	burst_count,
+	burst_total,
+	typical_burst);
+#endif
+  burst_count = 0;
+  burst_total = 0;
+}
+
+/// Size to make a swapfile when asked for size bytes
+static memsize_t chunk_size(const struct snapshot *snap, memsize_t size)
+{
+  if (!growth()) return size;
+  close_burst();
+
+  memsize_t chunk = burst_count ? burst_chunk/100*growth() : typical_burst;
+  chunk = MAX(chunk, min_swapsize);
+  chunk = MIN(chunk, max_swapsize);
+  chunk = MIN(chunk, snap->swapfs_free/2);
+  return MAX(size, chunk);
+}
+
+/// Record swapfile of size bytes, created when asked for request bytes
+static void note_chunk(memsize_t request, memsize_t size)
+{
+  if (!growth()) return;
+  if (!burst_count) burst_request = request;
+  ++burst_count;
+  burst_chunk = size;
+  burst_total += size;
+  burst_last = runclock;
+}
+
+
 /// Find a free swapfile slot, or return last if none available
 static int find_free(int last)
 {
   assert(last >= 0);
   assert(last < MAX_SWAPFILES);
   int i;
-  for (i = last+1; i < MAX_SWAPFILES && swapfiles[i].size; ++i);
-  if (i >= MAX_SWAPFILES) for (i = 0; i < last && swapfiles[i].size; ++i);
+  for (i = last+1; i < MAX_SWAPFILES && slot_taken(i); ++i);
+  if (i >= MAX_SWAPFILES) for (i = 0; i < last && slot_taken(i); ++i);
   return i;
 }
 
 
-bool alloc_swapfile(memsize_t size)
+bool alloc_swapfile(const struct snapshot *snap, memsize_t size)
 {
+  const memsize_t request = size;
+  size = chunk_size(snap, size);
+
   /* Round request to page size, then add a bit for swapfile overhead.  Clever
    * readers will notice that this relies on getpagesize() returning a power of
    * two.
    */
   size = trunc_to_page(size) + 2*getpagesize();
   const int newswap = find_free(sequence_number);
-  if (unlikely(swapfiles[newswap].size)) return false;	// No free slot, sorry!
+  if (unlikely(slot_taken(newswap))) return false;	// No free slot, sorry!
 
-  if (unlikely(size > swapfs_free())) return false;	// Not enough disk space
+  if (unlikely(!snap->swaps)) return false;		// Don't know enough
+  if (unlikely(size > snap->swapfs_free)) return false;	// Not enough disk space
 
   // We can allocate another swapfile.  Great.
 #ifndef NO_CONFIG
@@ -862,6 +1155,8 @@ bool alloc_swapfile(memsize_t size)
 #endif
   char file[30];
   snprintf(file, sizeof(file), "%d", newswap);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
   swapfiles[newswap].size = make_swapfile(file, size);
   if (unlikely(!swapfiles[newswap].size)) return false;
 
@@ -874,8 +1169,8 @@ bool alloc_swapfile(memsize_t size)
       logm(LOG_NOTICE, "Quick swapfile creation disabled.");
       // If we get EINVAL, then we can't actually use posix_fallocate
       pfalloc_ok = false;
-      // Try again
-      return alloc_swapfile(size-2*getpagesize());
+      // Try again, with the original request so the burst learns from that
+      return alloc_swapfile(snap, request);
     }
     else
     {
@@ -884,14 +1179,23 @@ bool alloc_swapfile(memsize_t size)
     }
   }
 
+  swapfiles[newswap].created = runclock;
+  note_creation(size, &start);
+  note_chunk(request, swapfiles[newswap].size);
   sequence_number = inc_swapno(sequence_number);
+  all_swap += swapfiles[newswap].size;
+  cgroup_rebalance(all_swap);
 
   return true;
 }
 
 
-void free_swapfile(memsize_t maxsize)
+bool free_swapfile(const struct snapshot *snap, memsize_t maxsize)
 {
+  if (unlikely(!snap->swaps)) return false;
+  if (unlikely(drain_in_progress())) return false;
   const int victim = find_retirable(maxsize);
-  if (victim < MAX_SWAPFILES) retire_swapfile(victim);
+  if (victim == MAX_SWAPFILES) return false;
+  if (swapfiles[victim].used >= SLOW_SWAPOFF) return drain_swapfile(victim);
+  return retire_swapfile(victim);
 }
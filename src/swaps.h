@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #define SWAPSPACE_SWAPS_H
 
 #include "memory.h"
+#include "snapshot.h"
 
 /// Dump statistics to stdout
 void dump_stats(void);
@@ -56,27 +57,49 @@ bool activate_old_swaps(void);
 
 /// Create a new swapfile.  Clobbers localbuf.
 /**
+ * @param snap Snapshot of system state, including swap directory's filesystem
  * @param size number of bytes to allocate
  * @return success
  */
-bool alloc_swapfile(memsize_t size);
+bool alloc_swapfile(const struct snapshot *snap, memsize_t size);
+
+/// Smallest swapfile we will create, i.e. the unit of change in swap space
+memsize_t swapfile_quantum(void);
+
+/// Expected time to create a swapfile of given size, in seconds
+/** Based on how long it took to create earlier swapfiles.
+ */
+double swapfile_creation_time(memsize_t size);
 
 /// Free swap space
-/**
+/** A swapfile with much of its space in use takes a while to disable, since
+ * everything in it must be read back into memory.  Such a swapfile is drained
+ * in the background; see drain_in_progress().  Only one swapfile is freed at a
+ * time, so this does nothing while a drain is in progress.
+ *
+ * @param snap Snapshot of system state; swapfiles must be up to date with it
  * @param maxsize maximum amount of memory that may be freed
+ * @return Whether a swapfile was freed, or started draining
  */
-void free_swapfile(memsize_t maxsize);
+bool free_swapfile(const struct snapshot *snap, memsize_t maxsize);
+
+/// Is a swapfile being disabled in the background?
+/** Once the drain is done, this deletes the swapfile.
+ */
+bool drain_in_progress(void);
 
 
 /// Attempt to get rid of all our swapfiles right now
 bool retire_all(void);
 
 
-/// Total space on swap directory's filesystem
-memsize_t swapfs_size(void);
-
-/// Amount of free space on swap directory's filesystem
-memsize_t swapfs_free(void);
+/// Free and total space on swap directory's filesystem
+/**
+ * @param freespace Receives space available to non-root users
+ * @param size Receives total size of the filesystem
+ * @return Success (on failure, both are set to zero)
+ */
+bool swapfs_stat(memsize_t *freespace, memsize_t *size);
 
 
 #ifndef NO_CONFIG
@@ -85,6 +108,7 @@ extern bool paranoid;
 
 char *set_min_swapsize(long long size);
 char *set_max_swapsize(long long size);
+char *set_chunk_growth(long long pct);
 char *set_swappath(long long dummy);
 char *set_paranoid(long long dummy);
 
@@ -0,0 +1,132 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include "log.h"
+#include "support.h"
+#include "thrash.h"
+
+
+/// Configuration items: rates (per second) that mean we're thrashing; 0 is off
+static long long thrash_swapin = 0, thrash_majfault = 0,
+		 thrash_allocstall = 0;
+
+#ifndef NO_CONFIG
+char *set_thrash_swapin(long long rate)
+{
+  thrash_swapin = rate;
+  return NULL;
+}
+char *set_thrash_majfault(long long rate)
+{
+  thrash_majfault = rate;
+  return NULL;
+}
+char *set_thrash_allocstall(long long rate)
+{
+  thrash_allocstall = rate;
+  return NULL;
+}
+#endif
+
+
+/// Last sample we computed rates from
+static struct vmstat last;
+/// When it was taken
+static struct timespec last_taken;
+static bool have_last = false;
+
+static struct vm_rates current;
+
+
+bool thrash_watched(void)
+{
+  return thrash_swapin || thrash_majfault || thrash_allocstall;
+}
+
+
+/// Is rate at or over threshold (or, if pct is less than 100, that part of it)?
+static inline bool over(double rate, long long threshold, int pct)
+{
+  return threshold && rate*100 >= (double)threshold*pct;
+}
+
+static bool over_thresholds(int pct)
+{
+  return over(current.swapin, thrash_swapin, pct) ||
+    over(current.majfault, thrash_majfault, pct) ||
+    over(current.allocstall, thrash_allocstall, pct);
+}
+
+
+void thrash_sample(const struct timespec *taken,
+    const struct vmstat *vs,
+    struct vm_rates *rates)
+{
+  if (vs && !have_last)
+  {
+    last = *vs;
+    last_taken = *taken;
+    have_last = true;
+  }
+  else if (vs)
+  {
+    const double secs = (taken->tv_sec - last_taken.tv_sec) +
+      (taken->tv_nsec - last_taken.tv_nsec) / 1e9;
+    if (secs >= 1)
+    {
+      current.swapin = (vs->pswpin - last.pswpin) / secs;
+      current.swapout = (vs->pswpout - last.pswpout) / secs;
+      current.majfault = (vs->pgmajfault - last.pgmajfault) / secs;
+      current.allocstall = (vs->allocstall - last.allocstall) / secs;
+      last = *vs;
+      last_taken = *taken;
+
+      if (!current.thrashing && over_thresholds(100))
+      {
+	current.thrashing = true;
+	logm(LOG_WARNING,
+	    "Thrashing: %.0f pages/s swapped in, %.0f out; "
+	    "%.0f major faults/s; %.0f allocation stalls/s",
+	    current.swapin,
+	    current.swapout,
+	    current.majfault,
+	    current.allocstall);
+      }
+      else if (current.thrashing && !over_thresholds(50))
+      {
+	current.thrashing = false;
+	logm(LOG_NOTICE, "No longer thrashing");
+      }
+    }
+  }
+  *rates = current;
+}
+
+
+void dump_thrash(const struct vm_rates *rates)
+{
+  logm(LOG_INFO,
+      "paging: %.0f pages/s in, %.0f out; %.0f major faults/s; "
+      "%.0f allocation stalls/s%s",
+      rates->swapin,
+      rates->swapout,
+      rates->majfault,
+      rates->allocstall,
+      rates->thrashing ? "; thrashing" : "");
+}
@@ -0,0 +1,71 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_THRASH_H
+#define SWAPSPACE_THRASH_H
+
+#include <time.h>
+
+#include "main.h"
+#include "vmstat.h"
+
+/* Once the working set no longer fits in memory, the system thrashes: pages are
+ * swapped out only to be faulted right back in.  More swap space doesn't help
+ * with that, and taking swap space away makes it worse, since everything in the
+ * swapfile has to be read back into memory first.  The paging rates in
+ * /proc/vmstat show when this is happening.
+ */
+
+/// Paging activity, per second
+struct vm_rates
+{
+  /// Pages swapped in and out
+  double swapin, swapout;
+  /// Major page faults
+  double majfault;
+  /// Allocations stalled on direct reclaim
+  double allocstall;
+  /// Is any of these over its threshold?
+  bool thrashing;
+};
+
+/// Is any thrashing threshold set?  If not, there's no need to sample.
+bool thrash_watched(void);
+
+/// Compute paging rates from a new sample of /proc/vmstat
+/** Rates are taken over at least a second; a sample that comes sooner after the
+ * last one is not used.  Thrashing starts once any rate reaches its threshold,
+ * and ends once all of them are below half their thresholds.  Both are logged.
+ *
+ * @param taken When the sample was taken (CLOCK_MONOTONIC)
+ * @param vs The sample, or NULL if none was taken
+ * @param rates Receives the latest rates
+ */
+void thrash_sample(const struct timespec *taken,
+    const struct vmstat *vs,
+    struct vm_rates *rates);
+
+/// Log paging rates
+void dump_thrash(const struct vm_rates *rates);
+
+#ifndef NO_CONFIG
+char *set_thrash_allocstall(long long rate);
+char *set_thrash_majfault(long long rate);
+char *set_thrash_swapin(long long rate);
+#endif
+
+#endif
@@ -0,0 +1,300 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+#include "log.h"
+#include "procfile.h"
+#include "reactor.h"
+#include "support.h"
+#include "tmpfs.h"
+
+
+/// Most tmpfs filesystems we keep track of
+#define MAX_TMPFS 64
+
+/// Longest mount point path we handle; mounts with longer paths are skipped
+#define TMPFS_PATH_MAX 256
+
+/// Refresh usage figures for this many mounts per call to tmpfs_usage()
+/** A machine running containers may have dozens of tmpfs mounts, nearly all of
+ * them tiny.  There's no need to statfs() all of them on every tick.
+ */
+#define TMPFS_BATCH 4
+
+/// Without change notification, reread the mount table this often (seconds)
+#define TMPFS_RESCAN_INTERVAL 60
+
+struct tmpfs_mount
+{
+  /// Device number of the filesystem
+  dev_t dev;
+  /// A place where it is mounted
+  char path[TMPFS_PATH_MAX];
+  /// Bytes in use, or -1 if we don't know yet
+  memsize_t used;
+  /// Size limit in bytes
+  memsize_t size;
+  /// Found in the latest scan of the mount table?
+  bool seen;
+};
+
+static struct tmpfs_mount mounts[MAX_TMPFS];
+static int num_mounts = 0;
+
+/// Next mount whose figures are due for a refresh
+static int cursor = 0;
+
+static struct procfile proc_mountinfo = PROCFILE("/proc/self/mountinfo");
+
+/// Is the reactor watching the mount table for us?
+static bool watching = false;
+/// Has the mount table changed since we last read it?
+static bool mounts_changed = true;
+/// runclock at last scan of the mount table
+static time_t last_scan = 0;
+/// Did we run out of room in mounts[] during the last scan?
+static bool mounts_overflow = false;
+
+
+/// Extract the next space-separated word from a mountinfo line
+static const char *next_word(const char **pos, size_t *len)
+{
+  const char *p = *pos;
+  while (*p == ' ') ++p;
+  const char *const word = p;
+  while (*p && *p != ' ') ++p;
+  *len = p - word;
+  *pos = p;
+  return word;
+}
+
+
+/// Copy path from mountinfo, where blanks and such are escaped as "\ooo"
+static void unescape(char dst[], const char src[], size_t len)
+{
+  size_t j = 0;
+  for (size_t i = 0; i < len; ++j)
+  {
+    if (src[i] == '\\' && len - i >= 4)
+    {
+      dst[j] = (char)((src[i+1]-'0')*64 + (src[i+2]-'0')*8 + (src[i+3]-'0'));
+      i += 4;
+    }
+    else
+    {
+      dst[j] = src[i++];
+    }
+  }
+  dst[j] = '\0';
+}
+
+
+/// Parse "major:minor" device number
+static dev_t parse_dev(const char *p)
+{
+  unsigned maj = 0, min = 0;
+  while (*p >= '0' && *p <= '9') maj = maj*10 + (*p++ - '0');
+  if (*p++ != ':') return 0;
+  while (*p >= '0' && *p <= '9') min = min*10 + (*p++ - '0');
+  return makedev(maj, min);
+}
+
+
+/// Add tmpfs filesystem to our table, or mark it as still there
+static void note_mount(dev_t dev, const char path[], size_t pathlen)
+{
+  int i;
+  for (i = 0; i < num_mounts && mounts[i].dev != dev; ++i);
+
+  if (i == num_mounts)
+  {
+    if (unlikely(num_mounts == MAX_TMPFS))
+    {
+      mounts_overflow = true;
+      return;
+    }
+    ++num_mounts;
+    mounts[i].dev = dev;
+    mounts[i].used = mounts[i].size = -1;
+    mounts[i].seen = false;
+  }
+
+  // A bind mount of a filesystem we've already seen in this scan adds nothing.
+  if (mounts[i].seen) return;
+  mounts[i].seen = true;
+  // The place where we first saw it mounted may have gone away, so update.
+  unescape(mounts[i].path, path, pathlen);
+}
+
+
+/// Parse a line of /proc/self/mountinfo
+/** Format: "id parent major:minor root mountpoint options [optional fields...]
+ * - fstype source superoptions".
+ */
+static void mountinfo_line(const char line[], size_t len, void *arg)
+{
+  const char *p = line, *path = NULL;
+  size_t pathlen = 0, wlen;
+  dev_t dev = 0;
+  for (int i = 0; i < 5; ++i)
+  {
+    const char *const w = next_word(&p, &wlen);
+    if (i == 2)
+    {
+      dev = parse_dev(w);
+    }
+    else if (i == 4)
+    {
+      path = w;
+      pathlen = wlen;
+    }
+  }
+
+  // Skip options and optional fields, up to a lone "-".  Filesystem type is
+  // next.
+  const char *w;
+  do w = next_word(&p, &wlen); while (wlen && !(wlen == 1 && *w == '-'));
+  w = next_word(&p, &wlen);
+
+  if (wlen != 5 || strncmp(w, "tmpfs", 5) != 0) return;
+  if (unlikely(!dev) || unlikely(pathlen >= TMPFS_PATH_MAX)) return;
+  note_mount(dev, path, pathlen);
+}
+
+
+/// Reread the mount table.  Clobbers localbuf.
+static bool scan_mounts(void)
+{
+  const int fd = proc_mountinfo.fd;
+  for (int i = 0; i < num_mounts; ++i) mounts[i].seen = false;
+  mounts_overflow = false;
+
+  if (unlikely(!procfile_lines(&proc_mountinfo, mountinfo_line, NULL)))
+  {
+    // The file has been closed; we'll have to do without notification.
+    if (watching) reactor_unwatch(fd);
+    watching = false;
+    return false;
+  }
+
+  // Forget about filesystems that are no longer mounted
+  int kept = 0;
+  for (int i = 0; i < num_mounts; ++i) if (mounts[i].seen)
+  {
+    if (kept != i) mounts[kept] = mounts[i];
+    ++kept;
+  }
+  num_mounts = kept;
+  if (cursor >= num_mounts) cursor = 0;
+
+  mounts_changed = false;
+  last_scan = runclock;
+#ifndef NO_CONFIG
+  if (verbose)
+    logm(LOG_DEBUG,
+	"Mount table read: %d tmpfs filesystems%s",
+	num_mounts,
+	mounts_overflow ? " (and more that we don't track)" : "");
+#endif
+  return true;
+}
+
+
+/// Update usage figures for one mount
+/** A tmpfs mounted with size=0 has no size limit, and doesn't report usage;
+ * it's counted as empty.
+ */
+static void refresh_mount(struct tmpfs_mount *m)
+{
+  struct stat st;
+  struct statfs fsinfo;
+  if (stat(m->path, &st) == -1 ||
+      st.st_dev != m->dev ||
+      statfs(m->path, &fsinfo) == -1 ||
+      fsinfo.f_type != TMPFS_MAGIC)
+  {
+    /* Gone, or something else has been mounted over it; we don't want to count
+     * that other filesystem twice.  Ignore this one for now.
+     */
+    m->used = m->size = -1;
+    return;
+  }
+  m->used = (memsize_t)(fsinfo.f_blocks - fsinfo.f_bfree) * fsinfo.f_bsize;
+  m->size = (memsize_t)fsinfo.f_blocks * fsinfo.f_bsize;
+}
+
+
+memsize_t tmpfs_usage(void)
+{
+  if (mounts_changed ||
+      (!watching && runclock - last_scan >= TMPFS_RESCAN_INTERVAL))
+    if (unlikely(!scan_mounts())) return -1;
+
+  for (int n = 0; n < TMPFS_BATCH && n < num_mounts; ++n)
+  {
+    refresh_mount(&mounts[cursor]);
+    cursor = (cursor + 1) % num_mounts;
+  }
+
+  memsize_t total = 0;
+  for (int i = 0; i < num_mounts; ++i)
+    if (mounts[i].used > 0) total += mounts[i].used;
+  return total;
+}
+
+
+/// The mount table has changed
+/** The kernel flags this as an exceptional condition on every open file
+ * description of mountinfo, until it is polled.  Which epoll has done for us.
+ */
+static void handle_mounts(int fd, uint32_t events)
+{
+  mounts_changed = true;
+}
+
+
+bool tmpfs_start(void)
+{
+  if (proc_mountinfo.fd == -1) return false;
+  watching = reactor_watch(proc_mountinfo.fd, EPOLLPRI, handle_mounts);
+#ifndef NO_CONFIG
+  if (watching && verbose) logm(LOG_DEBUG, "Watching mount table for changes");
+#endif
+  return watching;
+}
+
+
+void dump_tmpfs(void)
+{
+  for (int i = 0; i < num_mounts; ++i) if (mounts[i].used >= 0)
+    logm(LOG_INFO,
+	"tmpfs %s: %lld used of %lld",
+	mounts[i].path,
+	mounts[i].used,
+	mounts[i].size);
+  if (mounts_overflow)
+    logm(LOG_INFO, "(more tmpfs filesystems not tracked)");
+}
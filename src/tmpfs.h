@@ -0,0 +1,50 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_TMPFS_H
+#define SWAPSPACE_TMPFS_H
+
+#include "main.h"
+#include "memory.h"
+
+/* Data in tmpfs, like other shared memory, can never be dropped or written
+ * back to a file: the only way to get it out of memory is to swap it out.  We
+ * keep a table of tmpfs mounts from /proc/self/mountinfo, and remember how much
+ * data each of them holds.
+ */
+
+/// Bytes held in all tmpfs filesystems.  Clobbers localbuf.
+/** Rereads the mount table only if it has changed (or, if we can't tell, once a
+ * minute), and refreshes the figures of only a few mounts per call.  Mounts are
+ * counted once, even if they are bind-mounted in several places.
+ *
+ * This includes tmpfs data that has already been swapped out.
+ *
+ * @return Total tmpfs usage, or -1 if the mount table could not be read
+ */
+memsize_t tmpfs_usage(void);
+
+/// Have the reactor tell us about changes to the mount table
+/** Only does anything once tmpfs_usage() has been called.
+ * @return Whether we're watching for changes
+ */
+bool tmpfs_start(void);
+
+/// Log per-mount tmpfs usage
+void dump_tmpfs(void);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include "log.h"
+#include "support.h"
+#include "trend.h"
+
+/* Allocating a large swapfile takes time, especially if it has to be written
+ * out in full.  If we only start once free space has already dropped below
+ * lower_freelimit, a fast-growing workload may well run out of memory before
+ * the new swapfile is ready.  So we keep a short history of memory usage and
+ * fit a straight line through it.  The memory module uses this to see the limit
+ * coming, and start allocating ahead of time.
+ *
+ * Under memory pressure we may be sampled many times a second.  Keeping every
+ * sample would fill the history within moments, and fit the line to noise.  So
+ * samples closer together than TREND_SPACING replace the newest one, rather
+ * than being added to it.
+ */
+
+/// Ignore samples older than this (in seconds)
+#define TREND_WINDOW 120
+
+/// Minimum time between the samples we keep (in seconds)
+#define TREND_SPACING 1
+
+/// Number of samples to keep: enough to cover the window
+#define TREND_SAMPLES (TREND_WINDOW/TREND_SPACING)
+
+/// Minimum number of samples for a reliable forecast
+#define TREND_MIN_SAMPLES 5
+
+/// Minimum confidence for a reliable forecast
+#define TREND_MIN_CONFIDENCE 0.6
+
+struct trend_sample
+{
+  struct timespec taken;
+  memsize_t used;
+};
+
+/// Ring buffer of samples; next points to the slot for the next sample
+static struct trend_sample history[TREND_SAMPLES];
+static int next = 0;
+static int recorded = 0;
+
+
+/// Seconds from a to b
+static double secs_between(const struct timespec *a, const struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+
+void trend_sample(const struct timespec *taken,
+    memsize_t total,
+    memsize_t freespace,
+    struct forecast *fc)
+{
+  // Replace the newest sample if it's too close to the one before.
+  const int before = (next + TREND_SAMPLES - 2) % TREND_SAMPLES;
+  if (recorded < 2 ||
+      secs_between(&history[before].taken, taken) >= TREND_SPACING)
+  {
+    next = (next + 1) % TREND_SAMPLES;
+    if (recorded < TREND_SAMPLES) ++recorded;
+  }
+  const int newest = (next + TREND_SAMPLES - 1) % TREND_SAMPLES;
+  history[newest].taken = *taken;
+  history[newest].used = total - freespace;
+
+  /* Least-squares fit of used space against time.  Times are taken relative to
+   * the newest sample, and usage relative to its mean, to keep the sums small
+   * enough for a double to represent accurately.
+   */
+  int n = 0;
+  double sx = 0, sy = 0;
+  for (int i = 0; i < recorded; ++i)
+  {
+    const double age = secs_between(taken, &history[i].taken);
+    if (age < -TREND_WINDOW) continue;
+    ++n;
+    sx += age;
+    sy += history[i].used;
+  }
+
+  fc->samples = n;
+  fc->growth = 0;
+  fc->confidence = 0;
+  if (n < 2) return;
+
+  const double mx = sx/n, my = sy/n;
+  double sxx = 0, syy = 0, sxy = 0;
+  for (int i = 0; i < recorded; ++i)
+  {
+    const double age = secs_between(taken, &history[i].taken);
+    if (age < -TREND_WINDOW) continue;
+    const double dx = age - mx, dy = history[i].used - my;
+    sxx += dx*dx;
+    syy += dy*dy;
+    sxy += dx*dy;
+  }
+
+  if (unlikely(sxx <= 0)) return;
+  fc->growth = sxy / sxx;
+  // Coefficient of determination.  A perfectly flat line is perfectly steady.
+  fc->confidence = (syy > 0) ? (sxy*sxy) / (sxx*syy) : 1;
+}
+
+
+bool trend_reliable(const struct forecast *fc)
+{
+  return fc->samples >= TREND_MIN_SAMPLES &&
+    fc->confidence >= TREND_MIN_CONFIDENCE;
+}
+
+
+void dump_trend(const struct forecast *fc)
+{
+  logm(LOG_INFO,
+      "trend: usage changing by %lld bytes/s "
+      "(%d samples, %d%% confidence%s)",
+      (long long)fc->growth,
+      fc->samples,
+      (int)(fc->confidence*100),
+      trend_reliable(fc) ? "" : ", not acting on it");
+}
@@ -0,0 +1,58 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_TREND_H
+#define SWAPSPACE_TREND_H
+
+#include <time.h>
+
+#include "main.h"
+#include "memory.h"
+
+/// Where memory usage seems to be heading, based on recent history
+struct forecast
+{
+  /// Number of samples the forecast is based on
+  int samples;
+  /// Growth in used space (total minus free), in bytes per second
+  double growth;
+  /// How well a straight line fits the samples, from 0 (not at all) to 1
+  double confidence;
+};
+
+/// Record total and free space, and forecast where usage is going
+/** Used space is what we look at, not free space: adding or removing an unused
+ * swapfile changes free and total space by the same amount, but not their
+ * difference.
+ *
+ * @param taken When the sample was taken (CLOCK_MONOTONIC)
+ * @param total Total space, memory plus swap
+ * @param freespace Free space, as estimated by the memory module
+ * @param fc Receives forecast, including this sample
+ */
+void trend_sample(const struct timespec *taken,
+    memsize_t total,
+    memsize_t freespace,
+    struct forecast *fc);
+
+/// Is the forecast based on enough of a trend to act on?
+bool trend_reliable(const struct forecast *fc);
+
+/// Log forecast
+void dump_trend(const struct forecast *fc);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <string.h>
+
+#include <sys/param.h>
+
+#include "procfile.h"
+#include "support.h"
+#include "vmstat.h"
+
+
+static struct procfile proc_vmstat = PROCFILE("/proc/vmstat");
+
+
+/// Is this the field called name, or its breakdown for a zone (name_zone)?
+static inline bool field_zoned(const struct procfield *f, const char name[])
+{
+  const size_t len = strlen(name);
+  return memcmp(f->name, name, MIN(len, f->namelen)) == 0 &&
+    (f->namelen == len || (f->namelen > len+1 && f->name[len] == '_'));
+}
+
+
+void parse_vmstat(const char text[], struct vmstat *vs)
+{
+  memset(vs, 0, sizeof(*vs));
+
+  /* Field names have changed over the years.  Since Linux 5.8 there are
+   * pgscan_file and pgsteal_file; before that we make do with the totals for
+   * kswapd and direct reclaim (which, before Linux 4.8, are broken down by
+   * zone).  Since 5.9, workingset_refault and workingset_activate are split
+   * into _anon and _file.  Since 4.8, allocstall is broken down by zone.
+   */
+  memsize_t scan_all = 0, steal_all = 0;
+  bool have_file = false;
+
+  const char *pos = text;
+  struct procfield f;
+  while (procfile_field(&pos, &f))
+  {
+    if (f.namelen < 6 ||
+	(f.name[0] != 'p' && f.name[0] != 'w' && f.name[0] != 'a'))
+      continue;
+
+    if (field_is(&f, "pgscan_direct_throttle"))
+      continue;		// Counts events, not pages
+    else if (field_is(&f, "pgscan_file"))
+    {
+      vs->pgscan = f.value;
+      have_file = true;
+    }
+    else if (field_is(&f, "pgsteal_file"))
+    {
+      vs->pgsteal = f.value;
+      have_file = true;
+    }
+    else if (field_zoned(&f, "pgscan_kswapd") ||
+	field_zoned(&f, "pgscan_direct") ||
+	field_is(&f, "pgscan_khugepaged"))
+      scan_all += f.value;
+    else if (field_zoned(&f, "pgsteal_kswapd") ||
+	field_zoned(&f, "pgsteal_direct") ||
+	field_is(&f, "pgsteal_khugepaged"))
+      steal_all += f.value;
+    else if (field_is(&f, "workingset_refault_file") ||
+	field_is(&f, "workingset_refault"))
+      vs->refault = f.value;
+    else if (field_is(&f, "workingset_activate_file") ||
+	field_is(&f, "workingset_activate"))
+      vs->activate = f.value;
+    else if (field_is(&f, "pswpin"))
+      vs->pswpin = f.value;
+    else if (field_is(&f, "pswpout"))
+      vs->pswpout = f.value;
+    else if (field_is(&f, "pgmajfault"))
+      vs->pgmajfault = f.value;
+    else if (field_zoned(&f, "allocstall"))
+      vs->allocstall += f.value;
+  }
+
+  if (!have_file)
+  {
+    vs->pgscan = scan_all;
+    vs->pgsteal = steal_all;
+  }
+}
+
+
+bool read_vmstat(struct vmstat *vs)
+{
+  if (unlikely(procfile_read(&proc_vmstat) < 0)) return false;
+  parse_vmstat(localbuf, vs);
+  return true;
+}
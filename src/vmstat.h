@@ -0,0 +1,58 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_VMSTAT_H
+#define SWAPSPACE_VMSTAT_H
+
+#include "main.h"
+#include "memory.h"
+
+/// Paging counters from /proc/vmstat, since boot
+/** Where the kernel distinguishes between file and anonymous pages, the page
+ * reclaim counters are for file pages (i.e. page cache) only.
+ */
+struct vmstat
+{
+  /// Pages scanned for reclaim
+  memsize_t pgscan;
+  /// Pages reclaimed
+  memsize_t pgsteal;
+  /// Evicted pages that were faulted back in while their shadows were fresh
+  memsize_t refault;
+  /// Refaulted pages that went straight back onto the active list
+  memsize_t activate;
+
+  /// Pages swapped in and out
+  memsize_t pswpin, pswpout;
+  /// Major page faults, i.e. ones that had to wait for I/O
+  memsize_t pgmajfault;
+  /// Allocations that stalled on direct reclaim, in all zones
+  memsize_t allocstall;
+};
+
+/// Parse the text of /proc/vmstat
+/** Counters the kernel does not provide are left at zero.
+ */
+void parse_vmstat(const char text[], struct vmstat *vs);
+
+/// Sample /proc/vmstat.  Clobbers localbuf.
+/** Counters the kernel does not provide are left at zero.
+ * @return Success
+ */
+bool read_vmstat(struct vmstat *vs);
+
+#endif
@@ -0,0 +1,134 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#include "env.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "procfile.h"
+#include "support.h"
+#include "zoneinfo.h"
+
+
+static struct procfile proc_zoneinfo = PROCFILE("/proc/zoneinfo");
+static struct procfile proc_scale_factor =
+  PROCFILE("/proc/sys/vm/watermark_scale_factor");
+static struct procfile proc_min_free = PROCFILE("/proc/sys/vm/min_free_kbytes");
+
+
+/// Figures for the zone we're currently parsing, in pages
+struct zone
+{
+  memsize_t free, min, low, high, managed;
+  /// Have we seen the watermarks yet?  Per-cpu "high:" values come after.
+  bool seen_high;
+};
+
+struct zone_scan
+{
+  struct watermarks *wm;
+  struct zone zone;
+};
+
+
+static inline bool is_blank(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+/// Is word followed by whitespace, then a number?  If so, parse it.
+static bool word_value(const char **pos, const char word[], memsize_t *value)
+{
+  const size_t len = strlen(word);
+  const char *p = *pos;
+  if (strncmp(p, word, len) != 0 || !is_blank(p[len])) return false;
+  for (p += len; is_blank(*p); ++p);
+  if (*p < '0' || *p > '9') return false;
+  memsize_t v = 0;
+  while (*p >= '0' && *p <= '9') v = v*10 + (*p++ - '0');
+  *value = v;
+  *pos = p;
+  return true;
+}
+
+
+/// Add up figures for finished zone.  Zones without any memory don't count.
+static void end_zone(struct zone_scan *scan)
+{
+  const struct zone *const z = &scan->zone;
+  if (z->managed)
+  {
+    const memsize_t page = getpagesize();
+    scan->wm->free += z->free * page;
+    scan->wm->min += z->min * page;
+    scan->wm->low += z->low * page;
+    scan->wm->high += z->high * page;
+    if (z->free < z->low) ++scan->wm->zones_low;
+    if (z->free < z->min) ++scan->wm->zones_min;
+  }
+  memset(&scan->zone, 0, sizeof(scan->zone));
+}
+
+
+static void zoneinfo_line(const char line[], size_t len, void *arg)
+{
+  struct zone_scan *const scan = arg;
+  struct zone *const z = &scan->zone;
+
+  if (strncmp(line, "Node ", 5) == 0)
+  {
+    end_zone(scan);
+    return;
+  }
+
+  const char *p = line;
+  while (is_blank(*p)) ++p;
+  if (strncmp(p, "pages ", 6) == 0)
+  {
+    for (p += 6; is_blank(*p); ++p);
+    word_value(&p, "free", &z->free);
+  }
+  else if (!z->seen_high)
+  {
+    if (!word_value(&p, "min", &z->min) && !word_value(&p, "low", &z->low))
+      z->seen_high = word_value(&p, "high", &z->high);
+  }
+  else
+  {
+    word_value(&p, "managed", &z->managed);
+  }
+}
+
+
+bool read_watermarks(struct watermarks *wm)
+{
+  memset(wm, 0, sizeof(*wm));
+
+  struct zone_scan scan;
+  memset(&scan, 0, sizeof(scan));
+  scan.wm = wm;
+  if (unlikely(!procfile_lines(&proc_zoneinfo, zoneinfo_line, &scan)))
+    return false;
+  end_zone(&scan);
+
+  wm->scale_factor = (int)procfile_number(&proc_scale_factor);
+  wm->min_free = procfile_number(&proc_min_free);
+  if (wm->min_free > 0) wm->min_free *= KILO;
+
+  return wm->high > 0;
+}
@@ -0,0 +1,50 @@
+/*
+This file is part of Swapspace.
+
+Swapspace is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Swapspace is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with swapspace; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SWAPSPACE_ZONEINFO_H
+#define SWAPSPACE_ZONEINFO_H
+
+#include "main.h"
+#include "memory.h"
+
+/// Free memory and page reclaim watermarks, summed over all populated zones
+/** When a zone's free memory drops below its "low" watermark, kswapd wakes up
+ * to reclaim memory in the background until it's back above "high."  If free
+ * memory drops below "min," allocations stall in direct reclaim.
+ */
+struct watermarks
+{
+  memsize_t free, min, low, high;
+
+  /// Number of zones with free memory below their low watermark
+  int zones_low;
+  /// Number of zones with free memory below their min watermark
+  int zones_min;
+
+  /// /proc/sys/vm/watermark_scale_factor (in ten-thousandths), or -1
+  int scale_factor;
+  /// /proc/sys/vm/min_free_kbytes (in bytes), or -1
+  memsize_t min_free;
+};
+
+/// Sample /proc/zoneinfo and related settings.  Clobbers localbuf.
+/**
+ * @return Success
+ */
+bool read_watermarks(struct watermarks *wm);
+
+#endif